@@ -0,0 +1,80 @@
+#include "bench.h"
+
+#include <malloc.h>  // malloc_usable_size
+
+#include <cstdlib>
+#include <new>
+
+// Replacement allocation functions that count allocations per thread for `Measure`.
+// Memory comes from `std::malloc` / `std::aligned_alloc`, so every `operator delete`
+// releases it with `std::free`. `HeapBytes` follows the usable size of each block.
+
+namespace {
+
+void* Tracked(void* memory) {
+    HeapBytes().fetch_add(malloc_usable_size(memory), std::memory_order_relaxed);
+    return memory;
+}
+
+void Free(void* memory) noexcept {
+    HeapBytes().fetch_sub(malloc_usable_size(memory), std::memory_order_relaxed);
+    std::free(memory);
+}
+
+void* Allocate(size_t size) {
+    ++ThreadAllocations();
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return Tracked(memory);
+    }
+    throw std::bad_alloc();
+}
+
+void* AllocateAligned(size_t size, std::align_val_t alignment) {
+    ++ThreadAllocations();
+    size_t align = static_cast<size_t>(alignment);
+    // `aligned_alloc` wants a size that is a multiple of the alignment
+    if (void* memory = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return Tracked(memory);
+    }
+    throw std::bad_alloc();
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return Allocate(size);
+}
+void* operator new[](size_t size) {
+    return Allocate(size);
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+    return AllocateAligned(size, alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    Free(memory);
+}
+void operator delete[](void* memory) noexcept {
+    Free(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+    Free(memory);
+}
+void operator delete[](void* memory, size_t) noexcept {
+    Free(memory);
+}
+void operator delete(void* memory, std::align_val_t) noexcept {
+    Free(memory);
+}
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    Free(memory);
+}
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    Free(memory);
+}
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    Free(memory);
+}
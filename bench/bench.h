@@ -0,0 +1,140 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Minimal timing helpers shared by the benchmarks in this directory.
+
+// Keeps the optimizer from discarding a value computed by the benchmarked code.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Allocations made by the calling thread. Bumped by the replacement `operator new`
+// in alloc_hook.cpp, which every benchmark target links.
+inline size_t& ThreadAllocations() {
+    static thread_local size_t count = 0;
+    return count;
+}
+
+// Bytes currently allocated by all threads, as seen by the same hook
+inline std::atomic<size_t>& HeapBytes() {
+    static std::atomic<size_t> bytes = 0;
+    return bytes;
+}
+
+// A hardware event counted for the calling thread, cache misses by default. Reads -1 where
+// perf events are unavailable, e.g. in containers or with a restrictive perf_event_paranoid.
+class PerfCounter {
+public:
+    explicit PerfCounter(uint64_t config = PERF_COUNT_HW_CACHE_MISSES) {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+    ~PerfCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    void Start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    // Events since `Start`
+    int64_t Stop() {
+        int64_t count = -1;
+        if (fd_ < 0) {
+            return count;
+        }
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+            count = -1;
+        }
+        return count;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+// Everything `Measure` has run so far, for `ReportJson`
+inline std::vector<BenchResult>& BenchResults() {
+    static std::vector<BenchResult> results;
+    return results;
+}
+
+// Runs `body` `iterations` times and prints the average cost of one call.
+template <typename F>
+double Measure(const char* name, size_t iterations, F&& body) {
+    for (size_t i = 0; i < iterations / 10; ++i) {
+        body();
+    }
+    size_t allocations_before = ThreadAllocations();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        body();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    double ns_per_op =
+        std::chrono::duration<double, std::nano>(finish - start).count() / iterations;
+    double allocs_per_op =
+        static_cast<double>(ThreadAllocations() - allocations_before) / iterations;
+    std::printf("%-52s %10.2f ns/op %8.2f allocs/op\n", name, ns_per_op, allocs_per_op);
+    BenchResults().push_back({name, ns_per_op, allocs_per_op});
+    return ns_per_op;
+}
+
+// Writes the collected results to the file given as `--json=<path>`, if any:
+// [{"name": "...", "ns_per_op": 1.23, "allocs_per_op": 1}, ...]
+inline void ReportJson(int argc, char** argv) {
+    constexpr const char* kFlag = "--json=";
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], kFlag, std::strlen(kFlag)) != 0) {
+            continue;
+        }
+        FILE* file = std::fopen(argv[i] + std::strlen(kFlag), "w");
+        if (file == nullptr) {
+            std::perror(argv[i]);
+            return;
+        }
+        std::fprintf(file, "[");
+        const auto& results = BenchResults();
+        for (size_t j = 0; j < results.size(); ++j) {
+            std::fprintf(file,
+                         "%s\n  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}",
+                         j == 0 ? "" : ",", results[j].name.c_str(), results[j].ns_per_op,
+                         results[j].allocs_per_op);
+        }
+        std::fprintf(file, "\n]\n");
+        std::fclose(file);
+    }
+}
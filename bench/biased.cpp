@@ -0,0 +1,57 @@
+#include "bench.h"
+
+#include "shared.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Multi-thread copy throughput of `Biased` counts against plain atomic counts.
+//
+// "owner": every thread copies a pointer it created itself (the common case)
+// "foreign": every thread copies one pointer created by the main thread
+
+constexpr size_t kCopiesPerThread = 20'000'000;
+
+template <typename Policy, typename MakeSource>
+void RunThreads(const char* name, size_t threads, MakeSource make_source) {
+    std::atomic<bool> start = false;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&start, &make_source] {
+            SharedPtr<int, Policy> source = make_source();
+            while (!start.load()) {
+            }
+            for (size_t j = 0; j < kCopiesPerThread; ++j) {
+                SharedPtr<int, Policy> copy(source);
+                DoNotOptimize(copy);
+            }
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::printf("%-24s %2zu threads %10.1f Mcopies/s\n", name, threads,
+                threads * kCopiesPerThread / seconds / 1e6);
+}
+
+template <typename Policy>
+void Run(const char* owner_name, const char* foreign_name, size_t threads) {
+    RunThreads<Policy>(owner_name, threads, [] { return MakeShared<int, Policy>(42); });
+    auto shared = MakeShared<int, Policy>(42);
+    RunThreads<Policy>(foreign_name, threads, [&shared] { return shared; });
+}
+
+int main() {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        Run<MultiThreaded>("atomic, owner", "atomic, foreign", threads);
+        Run<Biased>("biased, owner", "biased, foreign", threads);
+        Biased::MergeQueued();
+    }
+}
@@ -0,0 +1,100 @@
+#include "bench.h"
+
+#include "compact_shared.h"
+#include "shared.h"
+
+#include <common/arena.h>
+#include <intrusive/compact_intrusive.h>
+#include <intrusive/intrusive.h>
+
+#include <random>
+#include <vector>
+
+// Random walks over a graph whose edges are owning pointers, with full-width pointers
+// against 32-bit arena offsets. Every step loads one edge of the current node and follows
+// it, so the walk is bound by cache misses and the node size decides how many of them
+// there are. Cache misses per step come from perf events when they are available.
+
+constexpr size_t kNodes = 1 << 21;
+constexpr size_t kDegree = 8;
+constexpr size_t kSteps = 20'000'000;
+
+struct GraphTag {};
+using GraphArena = Arena<GraphTag>;
+
+struct IntrusiveNode : SimpleRefCounted<IntrusiveNode> {
+    uint32_t value = 0;
+    IntrusivePtr<IntrusiveNode> edges[kDegree];
+};
+
+struct CompactIntrusiveNode : SimpleRefCounted<CompactIntrusiveNode, ArenaDelete<GraphArena>> {
+    uint32_t value = 0;
+    CompactIntrusivePtr<CompactIntrusiveNode, GraphArena> edges[kDegree];
+};
+
+struct SharedNode {
+    uint32_t value = 0;
+    SharedPtr<SharedNode> edges[kDegree];
+};
+
+struct CompactSharedNode {
+    uint32_t value = 0;
+    CompactSharedPtr<CompactSharedNode, GraphArena> edges[kDegree];
+};
+
+// Builds the graph with `make`, walks it and breaks the cycles to release it
+template <typename Ptr, typename Make>
+void RunWalk(const char* name, Make make) {
+    std::vector<Ptr> nodes;
+    nodes.reserve(kNodes);
+    std::mt19937 random(42);
+    for (size_t i = 0; i < kNodes; ++i) {
+        nodes.push_back(make());
+        nodes.back()->value = random();
+    }
+    for (auto& node : nodes) {
+        for (auto& edge : node->edges) {
+            edge = nodes[random() % kNodes];
+        }
+    }
+
+    auto* cursor = nodes[0].Get();
+    uint32_t step = 0;
+    PerfCounter misses;
+    misses.Start();
+    // Counts the warm-up round of `Measure` as well
+    Measure(name, kSteps, [&cursor, &step] {
+        cursor = cursor->edges[(cursor->value ^ step++) % kDegree].Get();
+        DoNotOptimize(cursor);
+    });
+    int64_t miss_count = misses.Stop();
+    if (miss_count >= 0) {
+        std::printf("%-52s %10.2f misses/step, %zu-byte pointer, %zu-byte node\n", "",
+                    double(miss_count) / (kSteps + kSteps / 10), sizeof(Ptr),
+                    sizeof(*nodes[0]));
+    } else {
+        std::printf("%-52s %10s misses/step, %zu-byte pointer, %zu-byte node\n", "", "n/a",
+                    sizeof(Ptr), sizeof(*nodes[0]));
+    }
+
+    for (auto& node : nodes) {
+        for (auto& edge : node->edges) {
+            edge.Reset();
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::printf("Random walk over %zu nodes with %zu owning edges each\n", kNodes, kDegree);
+    RunWalk<IntrusivePtr<IntrusiveNode>>("IntrusivePtr", [] {
+        return MakeIntrusive<IntrusiveNode>();
+    });
+    RunWalk<CompactIntrusivePtr<CompactIntrusiveNode, GraphArena>>("CompactIntrusivePtr", [] {
+        return MakeCompactIntrusive<CompactIntrusiveNode, GraphArena>();
+    });
+    RunWalk<SharedPtr<SharedNode>>("SharedPtr", [] { return MakeShared<SharedNode>(); });
+    RunWalk<CompactSharedPtr<CompactSharedNode, GraphArena>>("CompactSharedPtr", [] {
+        return MakeCompactShared<CompactSharedNode, GraphArena>();
+    });
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include "shared.h"
+
+// Copy/destroy cost of `SharedPtr` against the previous control block layout,
+// where every counter access was a virtual call on `BaseBlock`.
+
+namespace legacy {
+
+struct BaseBlock {
+    virtual void IncStrongCounter() = 0;
+    virtual void DecStrongCounter() = 0;
+    virtual size_t GetStrongCounter() = 0;
+    virtual ~BaseBlock(){};
+};
+
+template <typename T>
+struct ControlBlockPointer : BaseBlock {
+    ControlBlockPointer(T* object) : object_(object){};
+    void IncStrongCounter() override {
+        ++strong_counter_;
+    }
+    void DecStrongCounter() override {
+        if (--strong_counter_ == 0) {
+            delete object_;
+            delete this;
+        }
+    }
+    size_t GetStrongCounter() override {
+        return strong_counter_;
+    }
+    T* object_ = nullptr;
+    size_t strong_counter_ = 1;
+    size_t weak_counter_ = 0;
+};
+
+// Just enough of the old `SharedPtr` to copy, destroy and count
+template <typename T>
+class SharedPtr {
+public:
+    explicit SharedPtr(T* ptr) : block_(new ControlBlockPointer<T>(ptr)), observed_(ptr){};
+    SharedPtr(const SharedPtr& other) : block_(other.block_), observed_(other.observed_) {
+        block_->IncStrongCounter();
+    }
+    ~SharedPtr() {
+        block_->DecStrongCounter();
+    }
+    size_t UseCount() const {
+        return block_->GetStrongCounter();
+    }
+
+private:
+    BaseBlock* block_;
+    T* observed_;
+};
+
+}  // namespace legacy
+
+template <typename Ptr>
+void Run(const char* copy_name, const char* use_count_name, Ptr source) {
+    constexpr size_t kIterations = 50'000'000;
+    Measure(copy_name, kIterations, [&source] {
+        Ptr copy(source);
+        DoNotOptimize(copy);
+    });
+    Measure(use_count_name, kIterations, [&source] { DoNotOptimize(source.UseCount()); });
+}
+
+int main(int argc, char** argv) {
+    std::printf("sizeof(legacy::ControlBlockPointer<int>) = %zu\n",
+                sizeof(legacy::ControlBlockPointer<int>));
+    std::printf("sizeof(ControlBlockPointer<int>)         = %zu\n",
+                sizeof(ControlBlockPointer<int, SingleThreaded>));
+    std::printf("sizeof(ControlBlockPointer<int, Packed>) = %zu\n",
+                sizeof(ControlBlockPointer<int, Packed>));
+
+    Run("legacy virtual block: copy + destroy", "legacy virtual block: UseCount",
+        legacy::SharedPtr<int>(new int(42)));
+    Run("SharedPtr: copy + destroy", "SharedPtr: UseCount", SharedPtr<int>(new int(42)));
+    Run("SharedPtr<MultiThreaded>: copy + destroy", "SharedPtr<MultiThreaded>: UseCount",
+        SharedPtr<int, MultiThreaded>(new int(42)));
+    Run("SharedPtr<Packed>: copy + destroy", "SharedPtr<Packed>: UseCount",
+        SharedPtr<int, Packed>(new int(42)));
+    ReportJson(argc, argv);
+}
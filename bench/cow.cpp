@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include "cow.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+// Request headers handed to handlers that mostly read them: a deep copy of the map for every
+// handler against a `CowPtr` copy, which only clones when a handler writes.
+
+constexpr size_t kIterations = 200'000;
+constexpr size_t kEntries = 64;
+
+using Headers = std::map<std::string, std::string>;
+
+// About 4 KiB of keys and values, in 64 map nodes
+Headers MakeHeaders() {
+    Headers headers;
+    for (size_t i = 0; i < kEntries; ++i) {
+        headers.emplace("x-header-name-" + std::to_string(i),
+                        std::string(46, static_cast<char>('a' + i % 26)));
+    }
+    return headers;
+}
+
+size_t PayloadBytes(const Headers& headers) {
+    size_t bytes = 0;
+    for (const auto& [key, value] : headers) {
+        bytes += key.size() + value.size();
+    }
+    return bytes;
+}
+
+// What a handler reads
+size_t Read(const Headers& headers) {
+    return headers.find("x-header-name-7")->second.size();
+}
+
+int main(int argc, char** argv) {
+    const Headers headers = MakeHeaders();
+    std::printf("%zu headers, %zu bytes of keys and values\n", headers.size(),
+                PayloadBytes(headers));
+
+    Measure("deep copy + read", kIterations, [&headers] {
+        Headers copy = headers;
+        DoNotOptimize(Read(copy));
+    });
+    CowPtr<Headers> shared(headers);
+    Measure("CowPtr copy + read", kIterations, [&shared] {
+        CowPtr<Headers> copy = shared;
+        DoNotOptimize(Read(*copy));
+    });
+    CowPtr<Headers, MultiThreaded> shared_atomic(headers);
+    Measure("CowPtr<MultiThreaded> copy + read", kIterations, [&shared_atomic] {
+        CowPtr<Headers, MultiThreaded> copy = shared_atomic;
+        DoNotOptimize(Read(*copy));
+    });
+
+    // One handler in eight adds a header
+    size_t handler = 0;
+    Measure("deep copy, 1/8 writes", kIterations, [&headers, &handler] {
+        Headers copy = headers;
+        if (++handler % 8 == 0) {
+            copy["x-forwarded-for"] = "10.0.0.1";
+        }
+        DoNotOptimize(Read(copy));
+    });
+    Measure("CowPtr copy, 1/8 writes", kIterations, [&shared, &handler] {
+        CowPtr<Headers> copy = shared;
+        if (++handler % 8 == 0) {
+            copy.Mutate()["x-forwarded-for"] = "10.0.0.1";
+        }
+        DoNotOptimize(Read(*copy));
+    });
+
+    // The sole owner writes in place: no clone, only the uniqueness check
+    CowPtr<Headers> owned(headers);
+    Measure("CowPtr::Mutate, sole owner", kIterations, [&owned] {
+        owned.Mutate()["x-request-id"] = "1";
+        DoNotOptimize(Read(*owned));
+    });
+
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+
+#include "shared.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// One object that is both counter-hot and object-hot: half of the threads copy a pointer
+// to it, the other half keep reading its first field. With the default layout the counts
+// and that field share a cache line, so every copy takes the line away from the readers;
+// `CacheIsolated` puts them on separate lines.
+
+constexpr auto kDuration = std::chrono::milliseconds(500);
+
+struct HotObject {
+    std::atomic<long long> value = 1;
+    long long payload[6] = {};
+};
+
+template <typename Policy>
+void Run(const char* name, size_t copiers, size_t readers) {
+    auto shared = MakeShared<HotObject, Policy>();
+    std::atomic<bool> start = false;
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> copies = 0;
+    std::atomic<size_t> reads = 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < copiers; ++i) {
+        workers.emplace_back([&] {
+            while (!start.load()) {
+            }
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int j = 0; j < 256; ++j) {
+                    SharedPtr<HotObject, Policy> copy(shared);
+                    DoNotOptimize(copy);
+                }
+                count += 256;
+            }
+            copies += count;
+        });
+    }
+    for (size_t i = 0; i < readers; ++i) {
+        workers.emplace_back([&] {
+            HotObject* object = shared.Get();
+            while (!start.load()) {
+            }
+            size_t count = 0;
+            long long sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int j = 0; j < 256; ++j) {
+                    sum += object->value.load(std::memory_order_relaxed);
+                }
+                count += 256;
+            }
+            DoNotOptimize(sum);
+            reads += count;
+        });
+    }
+    start = true;
+    std::this_thread::sleep_for(kDuration);
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(kDuration).count();
+    std::printf("%-28s %2zu copiers %2zu readers %10.1f Mcopies/s %10.1f Mreads/s\n", name,
+                copiers, readers, copies / seconds / 1e6, reads / seconds / 1e6);
+}
+
+int main() {
+    size_t max_threads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+        Run<MultiThreaded>("atomic, shared line", threads / 2, threads / 2);
+        Run<CacheIsolated<>>("atomic, CacheIsolated<64>", threads / 2, threads / 2);
+        Run<CacheIsolated<MultiThreaded, 128>>("atomic, CacheIsolated<128>", threads / 2,
+                                               threads / 2);
+    }
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+
+#include <intrusive/intrusive.h>
+
+#include <memory>
+#include <utility>
+
+// `IntrusivePtr` against `std::shared_ptr`, which keeps its counts in a separate block.
+
+constexpr size_t kIterations = 20'000'000;
+
+struct Node : SimpleRefCounted<Node> {
+    int value = 42;
+};
+
+struct StdNode {
+    int value = 42;
+};
+
+int main(int argc, char** argv) {
+    Measure("std::make_shared + destroy", kIterations, [] {
+        auto ptr = std::make_shared<StdNode>();
+        DoNotOptimize(ptr);
+    });
+    Measure("MakeIntrusive + destroy", kIterations, [] {
+        auto ptr = MakeIntrusive<Node>();
+        DoNotOptimize(ptr);
+    });
+
+    auto std_source = std::make_shared<StdNode>();
+    Measure("std::shared_ptr: copy + destroy", kIterations, [&std_source] {
+        std::shared_ptr<StdNode> copy(std_source);
+        DoNotOptimize(copy);
+    });
+    auto source = MakeIntrusive<Node>();
+    Measure("IntrusivePtr: copy + destroy", kIterations, [&source] {
+        IntrusivePtr<Node> copy(source);
+        DoNotOptimize(copy);
+    });
+
+    Measure("std::shared_ptr: move + move back", kIterations, [&std_source] {
+        std::shared_ptr<StdNode> moved(std::move(std_source));
+        DoNotOptimize(moved);
+        std_source = std::move(moved);
+    });
+    Measure("IntrusivePtr: move + move back", kIterations, [&source] {
+        IntrusivePtr<Node> moved(std::move(source));
+        DoNotOptimize(moved);
+        source = std::move(moved);
+    });
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include "atomic_shared.h"
+#include "rcu.h"
+#include "shared.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Read throughput of a configuration object that a writer replaces every millisecond:
+// `RcuPtr::ReadLock` against `AtomicSharedPtr::Load` and a `SharedPtr` copied under a
+// mutex. Only the RCU readers stay off shared cache lines, so they should scale with the
+// number of cores.
+
+constexpr size_t kReadsPerThread = 5'000'000;
+
+struct Config {
+    explicit Config(int version) : version(version){};
+    int version;
+    int limits[15] = {};
+};
+
+using ConfigPtr = SharedPtr<Config, MultiThreaded>;
+
+// `read` returns the version seen by one read
+template <typename Read, typename Write>
+void Run(const char* name, size_t threads, Read read, Write write) {
+    std::atomic<bool> start = false;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < threads; ++i) {
+        readers.emplace_back([&start, &read] {
+            while (!start.load()) {
+            }
+            long long sum = 0;
+            for (size_t j = 0; j < kReadsPerThread; ++j) {
+                sum += read();
+            }
+            DoNotOptimize(sum);
+        });
+    }
+    std::thread writer([&start, &done, &write] {
+        while (!start.load()) {
+        }
+        for (int version = 1; !done.load(); ++version) {
+            write(version);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    done = true;
+    writer.join();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::printf("%-24s %2zu readers %10.1f Mreads/s\n", name, threads,
+                threads * kReadsPerThread / seconds / 1e6);
+}
+
+int main() {
+    RcuPtr<Config> rcu(MakeShared<Config, MultiThreaded>(0));
+    AtomicSharedPtr<Config> atomic(MakeShared<Config, MultiThreaded>(0));
+    std::mutex mutex;
+    ConfigPtr locked = MakeShared<Config, MultiThreaded>(0);
+
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        Run(
+            "RcuPtr::ReadLock", threads, [&rcu] { return rcu.ReadLock()->version; },
+            [&rcu](int version) { rcu.Publish(MakeShared<Config, MultiThreaded>(version)); });
+        Run(
+            "AtomicSharedPtr::Load", threads, [&atomic] { return atomic.Load()->version; },
+            [&atomic](int version) { atomic.Store(MakeShared<Config, MultiThreaded>(version)); });
+        Run(
+            "mutex + SharedPtr copy", threads,
+            [&mutex, &locked] {
+                ConfigPtr copy;
+                {
+                    std::lock_guard lock(mutex);
+                    copy = locked;
+                }
+                return copy->version;
+            },
+            [&mutex, &locked](int version) {
+                auto fresh = MakeShared<Config, MultiThreaded>(version);
+                std::lock_guard lock(mutex);
+                locked = std::move(fresh);
+            });
+    }
+}
@@ -0,0 +1,51 @@
+#include "bench.h"
+
+#include "shared.h"
+#include "sharded.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Copy throughput of one object copied by every thread, e.g. a global configuration:
+// plain atomic counts against `Sharded` counts. Sharded copies should scale with the
+// number of cores, while atomic ones all fight over the same cache line.
+
+constexpr size_t kCopiesPerThread = 20'000'000;
+
+template <typename Policy>
+void RunThreads(const char* name, size_t threads, const SharedPtr<int, Policy>& shared) {
+    std::atomic<bool> start = false;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&start, &shared] {
+            while (!start.load()) {
+            }
+            for (size_t j = 0; j < kCopiesPerThread; ++j) {
+                SharedPtr<int, Policy> copy(shared);
+                DoNotOptimize(copy);
+            }
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::printf("%-24s %2zu threads %10.1f Mcopies/s\n", name, threads,
+                threads * kCopiesPerThread / seconds / 1e6);
+}
+
+int main() {
+    auto atomic = MakeShared<int, MultiThreaded>(42);
+    auto sharded = MakeSharded<int>(42);
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        RunThreads("atomic", threads, atomic);
+        RunThreads("sharded", threads, sharded);
+    }
+    Retire(sharded);
+}
@@ -0,0 +1,72 @@
+#include "bench.h"
+
+#include "shared.h"
+
+#include <memory>
+#include <utility>
+
+// `SharedPtr` with both counter policies against `std::shared_ptr`.
+
+constexpr size_t kIterations = 20'000'000;
+
+// Adapts `std::shared_ptr` to the names used below
+struct Std {
+    using Ptr = std::shared_ptr<int>;
+    static Ptr Make(int value) {
+        return std::make_shared<int>(value);
+    }
+    static Ptr Adopt(int* object) {
+        return Ptr(object);
+    }
+    static size_t UseCount(const Ptr& ptr) {
+        return ptr.use_count();
+    }
+};
+
+template <typename Policy>
+struct Ours {
+    using Ptr = SharedPtr<int, Policy>;
+    static Ptr Make(int value) {
+        return MakeShared<int, Policy>(value);
+    }
+    static Ptr Adopt(int* object) {
+        return Ptr(object);
+    }
+    static size_t UseCount(const Ptr& ptr) {
+        return ptr.UseCount();
+    }
+};
+
+template <typename Impl>
+void Run(const char* prefix) {
+    using Ptr = typename Impl::Ptr;
+    std::string name = prefix;
+    Measure((name + ": construct(new) + destroy").c_str(), kIterations, [] {
+        Ptr ptr = Impl::Adopt(new int(42));
+        DoNotOptimize(ptr);
+    });
+    Measure((name + ": MakeShared + destroy").c_str(), kIterations, [] {
+        Ptr ptr = Impl::Make(42);
+        DoNotOptimize(ptr);
+    });
+
+    Ptr source = Impl::Make(42);
+    Measure((name + ": copy + destroy").c_str(), kIterations, [&source] {
+        Ptr copy(source);
+        DoNotOptimize(copy);
+    });
+    Measure((name + ": move + move back").c_str(), kIterations, [&source] {
+        Ptr moved(std::move(source));
+        DoNotOptimize(moved);
+        source = std::move(moved);
+    });
+    Measure((name + ": UseCount").c_str(), kIterations,
+            [&source] { DoNotOptimize(Impl::UseCount(source)); });
+}
+
+int main(int argc, char** argv) {
+    Run<Std>("std::shared_ptr");
+    Run<Ours<SingleThreaded>>("SharedPtr");
+    Run<Ours<MultiThreaded>>("SharedPtr<MultiThreaded>");
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+
+#include "shared.h"
+#include "shared_span.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Copying and destroying a vector of `SharedPtr`s that point to a few blocks (fan-out),
+// element by element against `CopySpan` / `DestroySpan`. Timings are per vector.
+
+constexpr size_t kElements = 4096;
+constexpr size_t kBlocks = 4;
+constexpr size_t kIterations = 20'000;
+constexpr size_t kThreadIterations = 2'000;
+
+using Ptr = SharedPtr<int, MultiThreaded>;
+
+std::vector<Ptr> FanOut() {
+    std::vector<Ptr> sources;
+    for (size_t i = 0; i < kBlocks; ++i) {
+        sources.push_back(MakeShared<int, MultiThreaded>(static_cast<int>(i)));
+    }
+    std::vector<Ptr> result;
+    for (size_t i = 0; i < kElements; ++i) {
+        result.push_back(sources[i % kBlocks]);
+    }
+    return result;
+}
+
+void CopyEach(const std::vector<Ptr>& source, std::vector<Ptr>& copy) {
+    for (size_t i = 0; i < source.size(); ++i) {
+        copy[i] = source[i];
+    }
+}
+
+void ResetEach(std::vector<Ptr>& ptrs) {
+    for (Ptr& ptr : ptrs) {
+        ptr.Reset();
+    }
+}
+
+// Every thread copies and destroys the same fan-out vector
+template <typename CopyAndDestroy>
+void RunThreads(const char* name, size_t threads, const std::vector<Ptr>& source,
+                CopyAndDestroy copy_and_destroy) {
+    std::atomic<bool> start = false;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&] {
+            std::vector<Ptr> copy(source.size());
+            while (!start.load()) {
+            }
+            for (size_t j = 0; j < kThreadIterations; ++j) {
+                copy_and_destroy(source, copy);
+            }
+        });
+    }
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+    std::printf("%-40s %2zu threads %10.1f ns/vector\n", name, threads, ns / kThreadIterations);
+}
+
+int main(int argc, char** argv) {
+    std::printf("%zu elements over %zu blocks, MultiThreaded counts\n", kElements, kBlocks);
+    std::vector<Ptr> source = FanOut();
+    std::vector<Ptr> copy(source.size());
+
+    Measure("per element: copy + reset", kIterations, [&] {
+        CopyEach(source, copy);
+        ResetEach(copy);
+    });
+    Measure("CopySpan + DestroySpan", kIterations, [&] {
+        CopySpan(source.data(), source.size(), copy.data());
+        DestroySpan(copy.data(), copy.size());
+    });
+    CopyEach(source, copy);
+    Measure("per element: assign", kIterations, [&] { CopyEach(source, copy); });
+    Measure("AssignSpan", kIterations,
+            [&] { AssignSpan(source.data(), source.size(), copy.data()); });
+    ResetEach(copy);
+
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        RunThreads("per element: copy + reset", threads, source, [](auto& from, auto& to) {
+            CopyEach(from, to);
+            ResetEach(to);
+        });
+        RunThreads("CopySpan + DestroySpan", threads, source, [](auto& from, auto& to) {
+            CopySpan(from.data(), from.size(), to.data());
+            DestroySpan(to.data(), to.size());
+        });
+    }
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,40 @@
+#include "bench.h"
+
+#include <unique/unique.h>
+
+#include <memory>
+#include <utility>
+
+// `UniquePtr` against `std::unique_ptr`.
+
+constexpr size_t kIterations = 20'000'000;
+
+template <typename Ptr>
+void Run(const char* prefix) {
+    std::string name = prefix;
+    Measure((name + ": construct + destroy").c_str(), kIterations, [] {
+        Ptr ptr(new int(42));
+        DoNotOptimize(ptr);
+    });
+
+    Ptr source(new int(42));
+    Measure((name + ": move + move back").c_str(), kIterations, [&source] {
+        Ptr moved(std::move(source));
+        DoNotOptimize(moved);
+        source = std::move(moved);
+    });
+    Measure((name + ": Reset(new)").c_str(), kIterations, [&source] {
+        if constexpr (std::is_same_v<Ptr, std::unique_ptr<int>>) {
+            source.reset(new int(1));
+        } else {
+            source.Reset(new int(1));
+        }
+        DoNotOptimize(source);
+    });
+}
+
+int main(int argc, char** argv) {
+    Run<std::unique_ptr<int>>("std::unique_ptr");
+    Run<UniquePtr<int>>("UniquePtr");
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,75 @@
+#include "bench.h"
+
+#include "shared.h"
+#include "weak.h"
+
+#include <memory>
+#include <utility>
+
+// `WeakPtr` with both counter policies against `std::weak_ptr`.
+
+constexpr size_t kIterations = 20'000'000;
+
+struct Std {
+    using Shared = std::shared_ptr<int>;
+    using Weak = std::weak_ptr<int>;
+    static Shared Make(int value) {
+        return std::make_shared<int>(value);
+    }
+    static Shared Lock(const Weak& weak) {
+        return weak.lock();
+    }
+};
+
+template <typename Policy>
+struct Ours {
+    using Shared = SharedPtr<int, Policy>;
+    using Weak = WeakPtr<int, Policy>;
+    static Shared Make(int value) {
+        return MakeShared<int, Policy>(value);
+    }
+    static Shared Lock(const Weak& weak) {
+        return weak.Lock();
+    }
+};
+
+template <typename Impl>
+void Run(const char* prefix) {
+    using Shared = typename Impl::Shared;
+    using Weak = typename Impl::Weak;
+    std::string name = prefix;
+
+    Shared shared = Impl::Make(42);
+    Measure((name + ": construct from shared + destroy").c_str(), kIterations, [&shared] {
+        Weak weak(shared);
+        DoNotOptimize(weak);
+    });
+
+    Weak weak(shared);
+    Measure((name + ": copy + destroy").c_str(), kIterations, [&weak] {
+        Weak copy(weak);
+        DoNotOptimize(copy);
+    });
+    Measure((name + ": move + move back").c_str(), kIterations, [&weak] {
+        Weak moved(std::move(weak));
+        DoNotOptimize(moved);
+        weak = std::move(moved);
+    });
+    Measure((name + ": Lock").c_str(), kIterations, [&weak] {
+        Shared locked = Impl::Lock(weak);
+        DoNotOptimize(locked);
+    });
+
+    Weak expired(Impl::Make(1));
+    Measure((name + ": Lock (expired)").c_str(), kIterations, [&expired] {
+        Shared locked = Impl::Lock(expired);
+        DoNotOptimize(locked);
+    });
+}
+
+int main(int argc, char** argv) {
+    Run<Std>("std::weak_ptr");
+    Run<Ours<SingleThreaded>>("WeakPtr");
+    Run<Ours<MultiThreaded>>("WeakPtr<MultiThreaded>");
+    ReportJson(argc, argv);
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// A contiguous range of address space that compact pointers refer to by 32-bit offsets.
+//
+// Offsets count `kAlignment`-byte units from the start of the range, so one arena spans
+// up to 32 GiB; offset 0 is never handed out and stands for null. `Tag` makes every arena
+// a separate type with its own range, so that a pointer only needs the offset: the base
+// address is a static of the arena. `kCapacity` bytes of address space are reserved (not
+// committed) on the first allocation.
+//
+// Memory comes from a bump pointer, with a free list per size for blocks of up to
+// `kMaxCachedSize` bytes; larger blocks are not reused. Nothing is returned to the system.
+template <typename Tag, size_t kCapacity = size_t(1) << 32>
+class Arena {
+public:
+    static constexpr size_t kAlignment = 8;
+    static constexpr size_t kMaxCachedSize = 1024;
+    static_assert(kCapacity / kAlignment <= (size_t(1) << 32), "offsets must fit in 32 bits");
+
+    static void* Allocate(size_t size) {
+        size = RoundUp(size);
+        std::lock_guard lock(Mutex());
+        if (base_.load(std::memory_order_relaxed) == nullptr) {
+            Reserve();
+        }
+        if (size <= kMaxCachedSize) {
+            FreeNode*& head = free_[size / kAlignment];
+            if (head != nullptr) {
+                FreeNode* node = head;
+                head = node->next;
+                return node;
+            }
+        }
+        if (kCapacity - used_ < size) {
+            throw std::bad_alloc();
+        }
+        void* memory = base_.load(std::memory_order_relaxed) + used_;
+        used_ += size;
+        return memory;
+    }
+
+    static void Deallocate(void* memory, size_t size) {
+        size = RoundUp(size);
+        if (size > kMaxCachedSize) {
+            return;
+        }
+        std::lock_guard lock(Mutex());
+        auto* node = static_cast<FreeNode*>(memory);
+        node->next = free_[size / kAlignment];
+        free_[size / kAlignment] = node;
+    }
+
+    static bool Contains(const void* address) {
+        auto* byte = static_cast<const char*>(address);
+        char* base = Base();
+        return base != nullptr && byte >= base && byte < base + kCapacity;
+    }
+
+    // Whether `ToOffset` can represent `address`: null or an aligned address in the arena
+    static bool Addressable(const void* address) {
+        if (address == nullptr) {
+            return true;
+        }
+        if (!Contains(address)) {
+            return false;
+        }
+        size_t bytes = static_cast<const char*>(address) - Base();
+        return bytes % kAlignment == 0;
+    }
+
+    static uint32_t ToOffset(const void* address) {
+        if (address == nullptr) {
+            return 0;
+        }
+        assert(Contains(address));
+        size_t bytes = static_cast<const char*>(address) - Base();
+        assert(bytes % kAlignment == 0);
+        return static_cast<uint32_t>(bytes / kAlignment);
+    }
+
+    template <typename T>
+    static T* FromOffset(uint32_t offset) {
+        if (offset == 0) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(Base() + size_t(offset) * kAlignment);
+    }
+
+    // Bytes handed out by the bump pointer so far, including blocks now in free lists
+    static size_t Used() {
+        std::lock_guard lock(Mutex());
+        return used_;
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static size_t RoundUp(size_t size) {
+        return (size + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    static void Reserve() {
+        void* memory = mmap(nullptr, kCapacity, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        base_.store(static_cast<char*>(memory), std::memory_order_release);
+        used_ = kAlignment;  // offset 0 is null
+    }
+
+    static std::mutex& Mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static char* Base() {
+        return base_.load(std::memory_order_acquire);
+    }
+
+    // Written once under the mutex, but `Contains` may read it from any thread at any time,
+    // including while the first `Allocate` is reserving the range
+    static inline std::atomic<char*> base_ = nullptr;
+    static inline size_t used_ = 0;
+    static inline FreeNode* free_[kMaxCachedSize / kAlignment + 1] = {};
+};
+
+// Standard allocator over an arena, e.g. for `AllocateShared`
+template <typename T, typename Arena>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U, Arena>&){};
+
+    T* allocate(size_t count) {
+        static_assert(alignof(T) <= Arena::kAlignment, "over-aligned types do not fit");
+        return static_cast<T*>(Arena::Allocate(count * sizeof(T)));
+    }
+    void deallocate(T* memory, size_t count) {
+        Arena::Deallocate(memory, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U, Arena>&) const {
+        return true;
+    }
+};
+
+// `RefCounted` deleter for objects placed in an arena
+template <typename Arena>
+struct ArenaDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        object->~T();
+        Arena::Deallocate(object, sizeof(T));
+    }
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Size-class pool for control blocks.
+//
+// Every thread keeps one free list per size class. A thread refills an empty list
+// from the global depot and spills an overfull one back to it in batches of
+// `kBatchSize` blocks, so the depot lock is taken once per batch rather than once
+// per block. Fresh memory is carved from slabs that are never returned to the system.
+//
+// The pool is opt-in: define SMART_POINTERS_POOLED_BLOCKS (consistently for the whole
+// program) to route control block allocations of `SharedPtr` / `MakeShared` through it.
+
+struct BlockPoolStats {
+    size_t hits = 0;          // allocations served from a thread cache
+    size_t misses = 0;        // allocations that went to the depot or carved a new slab
+    size_t bytes_cached = 0;  // free blocks sitting in thread caches and in the depot
+};
+
+class BlockPool {
+public:
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxBlockSize = 256;
+    static constexpr size_t kClassCount = kMaxBlockSize / kGranularity;
+    static constexpr size_t kBatchSize = 32;
+
+    static bool Fits(size_t size, size_t alignment) {
+        return size <= kMaxBlockSize && alignment <= kGranularity;
+    }
+
+    static void* Allocate(size_t size) {
+        size_t index = ClassIndex(size);
+        ThreadCache& cache = LocalCache();
+        FreeList& list = cache.lists[index];
+        if (list.head == nullptr) {
+            return AllocateSlow(cache, index);
+        }
+        FreeNode* node = list.head;
+        list.head = node->next;
+        --list.count;
+        Bump(cache.hits, 1);
+        Drop(cache.bytes_cached, ClassSize(index));
+        return node;
+    }
+
+    static void Deallocate(void* block, size_t size) {
+        size_t index = ClassIndex(size);
+        ThreadCache& cache = LocalCache();
+        if (!cache.registered || cache.exited) {
+            return DeallocateSlow(cache, block, index);
+        }
+        FreeList& list = cache.lists[index];
+        auto* node = static_cast<FreeNode*>(block);
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+        Bump(cache.bytes_cached, ClassSize(index));
+        if (list.count >= 2 * kBatchSize) {
+            Spill(cache, index, kBatchSize);
+        }
+    }
+
+    // Returns all blocks cached by the calling thread to the depot.
+    static void FlushThreadCache() {
+        ThreadCache& cache = LocalCache();
+        for (size_t index = 0; index < kClassCount; ++index) {
+            Spill(cache, index, cache.lists[index].count);
+        }
+    }
+
+    static BlockPoolStats Stats() {
+        Depot& depot = GetDepot();
+        std::lock_guard lock(depot.mutex);
+        BlockPoolStats stats = depot.retired;
+        stats.bytes_cached += depot.bytes_cached;
+        for (const ThreadCache* cache : depot.threads) {
+            stats.hits += cache->hits.load(std::memory_order_relaxed);
+            stats.misses += cache->misses.load(std::memory_order_relaxed);
+            stats.bytes_cached += cache->bytes_cached.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct FreeList {
+        FreeNode* head = nullptr;
+        size_t count = 0;
+    };
+
+    // Trivially destructible, so it stays usable while other thread_local and static
+    // objects are being destroyed; `Reaper` hands its contents back at thread exit.
+    struct ThreadCache {
+        FreeList lists[kClassCount];
+        std::atomic<size_t> hits = 0;
+        std::atomic<size_t> misses = 0;
+        std::atomic<size_t> bytes_cached = 0;
+        bool registered = false;
+        bool exited = false;
+    };
+
+    struct Depot {
+        std::mutex mutex;
+        std::vector<FreeList> batches[kClassCount];
+        std::vector<ThreadCache*> threads;
+        size_t bytes_cached = 0;
+        BlockPoolStats retired;  // counters of threads that have already exited
+    };
+
+    struct Reaper {
+        ~Reaper() {
+            ThreadCache& cache = LocalCache();
+            FlushThreadCache();
+            Depot& depot = GetDepot();
+            std::lock_guard lock(depot.mutex);
+            depot.retired.hits += cache.hits.load(std::memory_order_relaxed);
+            depot.retired.misses += cache.misses.load(std::memory_order_relaxed);
+            depot.threads.erase(std::find(depot.threads.begin(), depot.threads.end(), &cache));
+            cache.exited = true;
+        }
+    };
+
+    static size_t ClassIndex(size_t size) {
+        return size == 0 ? 0 : (size - 1) / kGranularity;
+    }
+
+    static size_t ClassSize(size_t index) {
+        return (index + 1) * kGranularity;
+    }
+
+    // Only the owning thread writes its counters, so a plain store is enough
+    static void Bump(std::atomic<size_t>& counter, size_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+    static void Drop(std::atomic<size_t>& counter, size_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+    }
+
+    static ThreadCache& LocalCache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // Never destroyed: blocks may still be released during static destruction
+    static Depot& GetDepot() {
+        static Depot* depot = new Depot;
+        return *depot;
+    }
+
+    static void Register(ThreadCache& cache) {
+        static thread_local Reaper reaper;
+        Depot& depot = GetDepot();
+        std::lock_guard lock(depot.mutex);
+        depot.threads.push_back(&cache);
+        cache.registered = true;
+    }
+
+    static void* AllocateSlow(ThreadCache& cache, size_t index) {
+        if (cache.exited) {
+            return ::operator new(ClassSize(index));
+        }
+        if (!cache.registered) {
+            Register(cache);
+        }
+        Bump(cache.misses, 1);
+
+        FreeList batch;
+        {
+            Depot& depot = GetDepot();
+            std::lock_guard lock(depot.mutex);
+            if (!depot.batches[index].empty()) {
+                batch = depot.batches[index].back();
+                depot.batches[index].pop_back();
+                depot.bytes_cached -= batch.count * ClassSize(index);
+            }
+        }
+        if (batch.head == nullptr) {
+            batch = CarveSlab(index);
+        }
+
+        FreeNode* node = batch.head;
+        FreeList& list = cache.lists[index];
+        list.head = node->next;
+        list.count = batch.count - 1;
+        Bump(cache.bytes_cached, list.count * ClassSize(index));
+        return node;
+    }
+
+    static void DeallocateSlow(ThreadCache& cache, void* block, size_t index) {
+        if (!cache.exited) {
+            Register(cache);
+            return Deallocate(block, ClassSize(index));
+        }
+        auto* node = static_cast<FreeNode*>(block);
+        node->next = nullptr;
+        Depot& depot = GetDepot();
+        std::lock_guard lock(depot.mutex);
+        depot.batches[index].push_back(FreeList{node, 1});
+        depot.bytes_cached += ClassSize(index);
+    }
+
+    static FreeList CarveSlab(size_t index) {
+        size_t block_size = ClassSize(index);
+        char* slab = static_cast<char*>(::operator new(kBatchSize * block_size));
+        FreeList batch;
+        for (size_t i = kBatchSize; i > 0; --i) {
+            auto* node = reinterpret_cast<FreeNode*>(slab + (i - 1) * block_size);
+            node->next = batch.head;
+            batch.head = node;
+        }
+        batch.count = kBatchSize;
+        return batch;
+    }
+
+    // Moves the first `count` blocks of a thread list to the depot as one batch
+    static void Spill(ThreadCache& cache, size_t index, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        FreeList& list = cache.lists[index];
+        FreeList batch{list.head, count};
+        FreeNode* last = list.head;
+        for (size_t i = 1; i < count; ++i) {
+            last = last->next;
+        }
+        list.head = last->next;
+        list.count -= count;
+        last->next = nullptr;
+        Drop(cache.bytes_cached, count * ClassSize(index));
+
+        Depot& depot = GetDepot();
+        std::lock_guard lock(depot.mutex);
+        depot.batches[index].push_back(batch);
+        depot.bytes_cached += count * ClassSize(index);
+    }
+};
+
+// Allocation entry points used by the control blocks.
+
+inline void* AllocateBlock(size_t size, size_t alignment) {
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+    if (BlockPool::Fits(size, alignment)) {
+        return BlockPool::Allocate(size);
+    }
+#endif
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return ::operator new(size, std::align_val_t(alignment));
+    }
+    return ::operator new(size);
+}
+
+inline void DeallocateBlock(void* block, size_t size, size_t alignment) {
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+    if (BlockPool::Fits(size, alignment)) {
+        return BlockPool::Deallocate(block, size);
+    }
+#endif
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return ::operator delete(block, size, std::align_val_t(alignment));
+    }
+    ::operator delete(block, size);
+}
+
+template <typename Block, typename... Args>
+Block* NewBlock(Args&&... args) {
+    void* memory = AllocateBlock(sizeof(Block), alignof(Block));
+    try {
+        return new (memory) Block(std::forward<Args>(args)...);
+    } catch (...) {
+        DeallocateBlock(memory, sizeof(Block), alignof(Block));
+        throw;
+    }
+}
+
+template <typename Block>
+void DeleteBlock(Block* block) {
+    block->~Block();
+    DeallocateBlock(block, sizeof(Block), alignof(Block));
+}
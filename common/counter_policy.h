@@ -0,0 +1,668 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Reference counting policies for the `SharedPtr` / `WeakPtr` control blocks.
+//
+// All policies use the "weak count holds +1 while any strong exists" scheme:
+// the weak counter starts at 1 on behalf of all strong owners together, and that
+// reference is dropped right after the object is destroyed. Releasing a strong
+// reference is therefore a single RMW, and the block is freed exactly when the
+// weak counter reaches zero.
+//
+// `AddStrong(n)` / `SubStrong(n)` take or release n strong references at once, for
+// the bulk operations in weak/shared_span.h.
+//
+// `UniqueStrong()` tells a sole owner that it may write to the object (weak/cow.h). Only
+// policies with an exact strong count provide it: not `Biased` nor `Sharded`.
+//
+// `kThreadSafe` tells whether pointers sharing a block may be copied and released on
+// different threads. Policies that wrap another one take it from their base.
+
+// Outcome of taking a strong reference from a weak one (`WeakPtr::Lock()`).
+// `TryIncStrong(retry)` only reports `kContended` when `retry` is false and another
+// thread changed the strong count between its read and its update.
+enum class LockStatus { kLocked, kExpired, kContended };
+
+// Plain counters, for data that never leaves a thread.
+//
+// With SMART_POINTERS_CHECK_OWNER set, blocks remember the thread that created them and
+// report copies made on another thread (`IncStrong` / `AddStrong`) through
+// `on_foreign_thread`, which asserts by default. Releases are not checked, so handing the
+// last reference to another thread and dropping it there is fine. The check is on unless
+// NDEBUG is defined. It adds a field to every block, so a program that mixes translation
+// units with and without NDEBUG must set the macro to 0 or 1 (consistently for the whole
+// program).
+#ifndef SMART_POINTERS_CHECK_OWNER
+#ifdef NDEBUG
+#define SMART_POINTERS_CHECK_OWNER 0
+#else
+#define SMART_POINTERS_CHECK_OWNER 1
+#endif
+#endif
+
+struct SingleThreaded {
+    static constexpr bool kThreadSafe = false;
+
+#if SMART_POINTERS_CHECK_OWNER
+    static inline void (*on_foreign_thread)() = [] {
+        assert(!"SingleThreaded pointer copied on a thread that does not own it");
+    };
+#endif
+
+    class RefCounts {
+    public:
+        void IncStrong() {
+            CheckOwner();
+            ++strong_;
+        }
+        // Returns true when the last strong reference is released.
+        bool DecStrong() {
+            return --strong_ == 0;
+        }
+        void AddStrong(size_t count) {
+            CheckOwner();
+            strong_ += count;
+        }
+        bool SubStrong(size_t count) {
+            return (strong_ -= count) == 0;
+        }
+        LockStatus TryIncStrong(bool /*retry*/) {
+            if (strong_ == 0) {
+                return LockStatus::kExpired;
+            }
+            ++strong_;
+            return LockStatus::kLocked;
+        }
+        void IncWeak() {
+            ++weak_;
+        }
+        // Returns true when the block itself may be freed.
+        bool DecWeak() {
+            return --weak_ == 0;
+        }
+        size_t Strong() const {
+            return strong_;
+        }
+        bool UniqueStrong() const {
+            return strong_ == 1;
+        }
+        size_t Weak() const {
+            return weak_;
+        }
+
+    private:
+        void CheckOwner() const {
+#if SMART_POINTERS_CHECK_OWNER
+            if (owner_ != std::this_thread::get_id()) {
+                on_foreign_thread();
+            }
+#endif
+        }
+
+        size_t strong_ = 1;
+        size_t weak_ = 1;
+#if SMART_POINTERS_CHECK_OWNER
+        std::thread::id owner_ = std::this_thread::get_id();
+#endif
+    };
+};
+
+// Atomic counters, safe to copy and release from any thread.
+// Increments are relaxed: a new reference can only be made from an existing one,
+// so there is nothing to synchronize with. Decrements are acq_rel so that every
+// write to the object happens-before its destruction on the releasing thread.
+struct MultiThreaded {
+    static constexpr bool kThreadSafe = true;
+
+    class RefCounts {
+    public:
+        void IncStrong() {
+            strong_.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool DecStrong() {
+            return strong_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        void AddStrong(size_t count) {
+            strong_.fetch_add(count, std::memory_order_relaxed);
+        }
+        bool SubStrong(size_t count) {
+            return strong_.fetch_sub(count, std::memory_order_acq_rel) == count;
+        }
+        // Increment-if-nonzero: once the count has dropped to zero the object is being
+        // destroyed and must not be resurrected
+        LockStatus TryIncStrong(bool retry) {
+            size_t strong = strong_.load(std::memory_order_relaxed);
+            while (true) {
+                if (strong == 0) {
+                    return LockStatus::kExpired;
+                }
+                size_t seen = strong;
+                if (strong_.compare_exchange_weak(strong, strong + 1, std::memory_order_relaxed)) {
+                    return LockStatus::kLocked;
+                }
+                // A spurious failure leaves `strong` unchanged and is simply retried
+                if (!retry && strong != seen) {
+                    return LockStatus::kContended;
+                }
+            }
+        }
+        void IncWeak() {
+            weak_.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool DecWeak() {
+            return weak_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        size_t Strong() const {
+            return strong_.load(std::memory_order_relaxed);
+        }
+        // Acquire: the other owners' releases happen before whatever the caller does next
+        bool UniqueStrong() const {
+            return strong_.load(std::memory_order_acquire) == 1;
+        }
+        size_t Weak() const {
+            return weak_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<size_t> strong_ = 1;
+        std::atomic<size_t> weak_ = 1;
+    };
+};
+
+// Atomic counters packed into one 64-bit word: strong in the low half, weak in the
+// high half. A snapshot of both counts is a single load, and a block for an adopted
+// pointer shrinks from 32 to 24 bytes on 64-bit targets.
+// Each count is capped at `kMaxCount`; crossing it terminates the program before a
+// carry can reach the other half. The headroom above the cap absorbs increments that
+// race with the one that detects the overflow.
+struct Packed {
+    static constexpr bool kThreadSafe = true;
+
+    class RefCounts {
+    public:
+        static constexpr uint64_t kMaxCount = (uint64_t(1) << 31) - 1;
+
+        void IncStrong() {
+            Add(kStrongShift);
+        }
+        bool DecStrong() {
+            return Count(word_.fetch_sub(kStrongOne, std::memory_order_acq_rel), kStrongShift) == 1;
+        }
+        void AddStrong(size_t count) {
+            if (count >= kMaxCount) {
+                std::terminate();
+            }
+            uint64_t old = word_.fetch_add(count * kStrongOne, std::memory_order_relaxed);
+            if (Count(old, kStrongShift) + count > kMaxCount) {
+                std::terminate();
+            }
+        }
+        bool SubStrong(size_t count) {
+            uint64_t old = word_.fetch_sub(count * kStrongOne, std::memory_order_acq_rel);
+            return Count(old, kStrongShift) == count;
+        }
+        LockStatus TryIncStrong(bool retry) {
+            uint64_t word = word_.load(std::memory_order_relaxed);
+            while (true) {
+                uint64_t strong = Count(word, kStrongShift);
+                if (strong == 0) {
+                    return LockStatus::kExpired;
+                }
+                if (strong >= kMaxCount) {
+                    std::terminate();
+                }
+                uint64_t seen = word;
+                if (word_.compare_exchange_weak(word, word + kStrongOne,
+                                                std::memory_order_relaxed)) {
+                    return LockStatus::kLocked;
+                }
+                if (!retry && word != seen) {
+                    return LockStatus::kContended;
+                }
+            }
+        }
+        void IncWeak() {
+            Add(kWeakShift);
+        }
+        bool DecWeak() {
+            return Count(word_.fetch_sub(kWeakOne, std::memory_order_acq_rel), kWeakShift) == 1;
+        }
+        size_t Strong() const {
+            return Count(word_.load(std::memory_order_relaxed), kStrongShift);
+        }
+        bool UniqueStrong() const {
+            return Count(word_.load(std::memory_order_acquire), kStrongShift) == 1;
+        }
+        size_t Weak() const {
+            return Count(word_.load(std::memory_order_relaxed), kWeakShift);
+        }
+
+    private:
+        static constexpr int kStrongShift = 0;
+        static constexpr int kWeakShift = 32;
+        static constexpr uint64_t kStrongOne = uint64_t(1) << kStrongShift;
+        static constexpr uint64_t kWeakOne = uint64_t(1) << kWeakShift;
+
+        static uint64_t Count(uint64_t word, int shift) {
+            return (word >> shift) & 0xFFFFFFFF;
+        }
+
+        void Add(int shift) {
+            uint64_t old = word_.fetch_add(uint64_t(1) << shift, std::memory_order_relaxed);
+            if (Count(old, shift) >= kMaxCount) {
+                std::terminate();
+            }
+        }
+
+        std::atomic<uint64_t> word_ = kStrongOne + kWeakOne;
+    };
+};
+
+// Biased reference counting: the thread that created the block updates a counter
+// that only it writes (plain load + store, no locked RMW), while every other thread
+// goes through an atomic shared counter.
+//
+// The shared counter keeps the count in units of `kOne` and a "merged" flag in bit 0.
+// It never goes negative: a thread that finds it at zero before the merge is holding
+// a reference accounted in the biased counter, so it hands that reference over to the
+// owner's queue instead of decrementing. The owner releases queued references in
+// `MergeQueued()` and when it exits. Once the owner's biased count drops to zero it
+// sets the flag, and from then on everybody uses the shared counter: the object dies
+// when the shared count is zero with the flag set.
+//
+// After the owner thread has exited, the first thread that needs to release a biased
+// reference folds the (now frozen) biased count into the shared counter itself.
+struct Biased {
+    static constexpr bool kThreadSafe = true;
+
+    class RefCounts;
+
+private:
+    class OwnerQueue;
+
+public:
+    // Releases the references other threads handed over to the calling thread.
+    // Call it periodically from long-lived owner threads, e.g. from an event loop.
+    static void MergeQueued() {
+        if (OwnerQueue* queue = Current(); queue != nullptr && queue != ExitedQueue()) {
+            queue->Drain(false);
+        }
+    }
+
+    class RefCounts {
+    public:
+        RefCounts() : owner_(AcquireQueue()) {
+            if (owner_ == ExitedQueue()) {
+                // Created during thread exit: nobody is left to own the biased count
+                merged_ = true;
+                biased_ = 0;
+                shared_ = kOne + kMerged;
+            }
+        }
+        RefCounts(const RefCounts&) = delete;
+        RefCounts& operator=(const RefCounts&) = delete;
+        ~RefCounts() {
+            owner_->Unref();
+        }
+
+        void IncStrong() {
+            AddStrong(1);
+        }
+        bool DecStrong() {
+            if (IsOwner()) {
+                size_t biased = biased_.load(std::memory_order_relaxed) - 1;
+                biased_.store(biased, std::memory_order_relaxed);
+                return biased == 0 && Merge();
+            }
+            int64_t shared = shared_.load(std::memory_order_relaxed);
+            while (true) {
+                if (shared == 0) {
+                    if (owner_->Defer(this)) {
+                        return false;
+                    }
+                    FoldBiased(shared);
+                    continue;
+                }
+                if (shared_.compare_exchange_weak(shared, shared - kOne, std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed)) {
+                    return shared - kOne == kMerged;
+                }
+            }
+        }
+        void AddStrong(size_t count) {
+            if (IsOwner()) {
+                biased_.store(biased_.load(std::memory_order_relaxed) + count,
+                              std::memory_order_relaxed);
+            } else {
+                shared_.fetch_add(static_cast<int64_t>(count) * kOne, std::memory_order_relaxed);
+            }
+        }
+        // One at a time: the references may be split between the biased and the shared
+        // counter, and only `DecStrong()` knows how to hand them over
+        bool SubStrong(size_t count) {
+            bool released = false;
+            for (size_t i = 0; i < count; ++i) {
+                released = DecStrong();
+            }
+            return released;
+        }
+        // Before the merge the owner's biased count keeps the object alive; after it the
+        // object is dead exactly when the shared counter holds nothing but the flag
+        LockStatus TryIncStrong(bool retry) {
+            if (IsOwner()) {
+                IncStrong();
+                return LockStatus::kLocked;
+            }
+            int64_t shared = shared_.load(std::memory_order_relaxed);
+            while (true) {
+                if (shared == kMerged) {
+                    return LockStatus::kExpired;
+                }
+                int64_t seen = shared;
+                if (shared_.compare_exchange_weak(shared, shared + kOne,
+                                                  std::memory_order_relaxed)) {
+                    return LockStatus::kLocked;
+                }
+                if (!retry && shared != seen) {
+                    return LockStatus::kContended;
+                }
+            }
+        }
+        void IncWeak() {
+            weak_.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool DecWeak() {
+            return weak_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        size_t Strong() const {
+            return biased_.load(std::memory_order_relaxed) +
+                   shared_.load(std::memory_order_relaxed) / kOne;
+        }
+        size_t Weak() const {
+            return weak_.load(std::memory_order_relaxed);
+        }
+
+        // Called with `block` when the last strong reference was released from the
+        // owner's queue rather than by `DecStrong()`'s caller.
+        void SetReleaseHook(void (*release)(void*), void* block) {
+            release_ = release;
+            block_ = block;
+        }
+
+    private:
+        friend struct Biased;
+
+        static constexpr int64_t kMerged = 1;
+        static constexpr int64_t kOne = 2;
+
+        bool IsOwner() const {
+            return owner_ == Current() && !merged_;
+        }
+
+        // Called by the owner once its biased count drops to zero
+        bool Merge() {
+            merged_ = true;
+            return shared_.fetch_or(kMerged, std::memory_order_acq_rel) == 0;
+        }
+
+        // The owner has exited, so the biased count can no longer change. Once moved into
+        // the shared counter it is cleared, so that `Strong()` does not count it twice.
+        void FoldBiased(int64_t& shared) {
+            int64_t biased = static_cast<int64_t>(biased_.load(std::memory_order_relaxed));
+            if (shared_.compare_exchange_strong(shared, biased * kOne + kMerged,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+                biased_.store(0, std::memory_order_relaxed);
+            }
+            shared = shared_.load(std::memory_order_relaxed);
+        }
+
+        OwnerQueue* owner_;
+        bool merged_ = false;  // only accessed by the owner thread
+        std::atomic<size_t> biased_ = 1;
+        std::atomic<int64_t> shared_ = 0;
+        std::atomic<size_t> weak_ = 1;
+        void (*release_)(void*) = nullptr;
+        void* block_ = nullptr;
+    };
+
+private:
+    // References handed over to an owner thread. Kept alive by the blocks that point to
+    // it, so it outlives its thread if blocks created there are still around.
+    class OwnerQueue {
+    public:
+        explicit OwnerQueue(bool exited) : exited_(exited){};
+
+        bool Defer(RefCounts* counts) {
+            std::lock_guard lock(mutex_);
+            if (exited_) {
+                return false;
+            }
+            pending_.push_back(counts);
+            return true;
+        }
+
+        void Drain(bool exit) {
+            while (true) {
+                std::vector<RefCounts*> pending;
+                {
+                    std::lock_guard lock(mutex_);
+                    if (pending_.empty()) {
+                        exited_ = exit;
+                        return;
+                    }
+                    pending.swap(pending_);
+                }
+                for (RefCounts* counts : pending) {
+                    if (counts->DecStrong()) {
+                        counts->release_(counts->block_);
+                    }
+                }
+            }
+        }
+
+        void Ref() {
+            users_.fetch_add(1, std::memory_order_relaxed);
+        }
+        void Unref() {
+            if (users_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<RefCounts*> pending_;
+        bool exited_;
+        std::atomic<size_t> users_ = 1;  // the owner thread itself, plus one per block
+    };
+
+    // Flushes the queue when the owner thread exits
+    struct Retirer {
+        ~Retirer() {
+            OwnerQueue* queue = Current();
+            queue->Drain(true);
+            Current() = ExitedQueue();
+            queue->Unref();
+        }
+    };
+
+    static OwnerQueue*& Current() {
+        static thread_local OwnerQueue* queue = nullptr;
+        return queue;
+    }
+
+    // Shared by blocks created while their thread is exiting; never freed
+    static OwnerQueue* ExitedQueue() {
+        static OwnerQueue* queue = new OwnerQueue(true);
+        return queue;
+    }
+
+    static OwnerQueue* AcquireQueue() {
+        OwnerQueue*& queue = Current();
+        if (queue == nullptr) {
+            queue = new OwnerQueue(false);
+            static thread_local Retirer retirer;
+        }
+        queue->Ref();
+        return queue;
+    }
+};
+
+// Strong counts spread over `kShards` cache lines, for the few objects that every thread
+// copies all the time (global configuration, schemas, pool handles). Each thread updates
+// the shard picked for it, so copies on different cores do not contend; a shard holds the
+// net change made through it and may go negative.
+//
+// The shards are never summed while the object is live, so its count cannot be seen to
+// reach zero: the owner keeps one reference until it hands it back with `Retire`
+// (weak/sharded.h). Retiring flags every shard and moves its total to a central counter;
+// updates that find their shard flagged go to the central counter instead, which from
+// then on detects the last release as usual. An object whose owner never retires it is
+// leaked. `Strong()` is only an estimate until then.
+template <size_t kShards = 16>
+struct Sharded {
+    static constexpr bool kThreadSafe = true;
+
+    class RefCounts {
+    public:
+        void IncStrong() {
+            AddStrong(1);
+        }
+        bool DecStrong() {
+            return SubStrong(1);
+        }
+        void AddStrong(size_t count) {
+            if (LocalShard().fetch_add(count, std::memory_order_relaxed) & kRetired) {
+                central_.fetch_add(count, std::memory_order_relaxed);
+            }
+        }
+        bool SubStrong(size_t count) {
+            if (!(LocalShard().fetch_sub(count, std::memory_order_release) & kRetired)) {
+                return false;
+            }
+            return central_.fetch_sub(count, std::memory_order_acq_rel) == count;
+        }
+        // An unflagged shard means the owner still holds its reference; an increment that
+        // lands in a flagged one is ignored there and retried on the central counter
+        LockStatus TryIncStrong(bool retry) {
+            if (!(LocalShard().fetch_add(1, std::memory_order_relaxed) & kRetired)) {
+                return LockStatus::kLocked;
+            }
+            uint64_t strong = central_.load(std::memory_order_relaxed);
+            while (true) {
+                if (strong == 0) {
+                    return LockStatus::kExpired;
+                }
+                uint64_t seen = strong;
+                if (central_.compare_exchange_weak(strong, strong + 1,
+                                                   std::memory_order_relaxed)) {
+                    return LockStatus::kLocked;
+                }
+                if (!retry && strong != seen) {
+                    return LockStatus::kContended;
+                }
+            }
+        }
+        // Ends the sharded phase and releases the caller's reference; returns true when
+        // that was the last one. Later calls only release the reference.
+        bool Retire() {
+            if (retiring_.exchange(true, std::memory_order_acq_rel)) {
+                return DecStrong();
+            }
+            uint64_t total = 0;
+            for (Shard& shard : shards_) {
+                total += shard.word.fetch_or(kRetired, std::memory_order_acq_rel) - kShardBias;
+            }
+            // Wraps around: drops the bias and the caller's reference in the same update
+            uint64_t delta = total - kCentralBias - 1;
+            return central_.fetch_add(delta, std::memory_order_acq_rel) + delta == 0;
+        }
+        void IncWeak() {
+            weak_.fetch_add(1, std::memory_order_relaxed);
+        }
+        bool DecWeak() {
+            return weak_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        size_t Strong() const {
+            uint64_t central = central_.load(std::memory_order_relaxed);
+            if (central < kCentralBias / 2) {
+                return central;
+            }
+            int64_t total = central - kCentralBias;
+            for (const Shard& shard : shards_) {
+                total += (shard.word.load(std::memory_order_relaxed) & ~kRetired) - kShardBias;
+            }
+            return total < 1 ? 1 : total;
+        }
+        size_t Weak() const {
+            return weak_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        // A shard starts at `kShardBias`, far from the flag in either direction. The central
+        // counter holds `kCentralBias` until retirement completes, so it cannot reach zero
+        // while shards are still being moved into it.
+        static constexpr uint64_t kRetired = uint64_t(1) << 63;
+        static constexpr uint64_t kShardBias = uint64_t(1) << 61;
+        static constexpr uint64_t kCentralBias = uint64_t(1) << 62;
+
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> word = kShardBias;
+        };
+
+        // Threads take shards round-robin as they first touch any sharded block
+        std::atomic<uint64_t>& LocalShard() {
+            static std::atomic<size_t> next = 0;
+            static thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+            return shards_[index % kShards].word;
+        }
+
+        Shard shards_[kShards];
+        alignas(64) std::atomic<uint64_t> central_ = kCentralBias + 1;
+        std::atomic<size_t> weak_ = 1;
+        std::atomic<bool> retiring_ = false;
+    };
+};
+
+// The counts of `Base` on a cache line of their own. Blocks are aligned to `kLineSize`, so
+// the block header (the manager and the counts) fills one line and the object that
+// `MakeShared` places after it starts on the next: copies on one core no longer invalidate
+// the line other cores use for the object's first fields. 64 bytes suits most x86 and ARM
+// cores; 128 also covers adjacent-line prefetch and Apple M-series.
+template <typename Base = MultiThreaded, size_t kLineSize = 64>
+struct CacheIsolated {
+    static constexpr bool kThreadSafe = Base::kThreadSafe;
+    static constexpr size_t kBlockAlignment = kLineSize;
+
+    class RefCounts : public Base::RefCounts {};
+};
+
+// Alignment of the blocks of `Policy`: that of its counts, raised to
+// `Policy::kBlockAlignment` if it has one
+template <typename Policy, typename = void>
+struct BlockAlignment : std::integral_constant<size_t, alignof(typename Policy::RefCounts)> {};
+
+template <typename Policy>
+struct BlockAlignment<Policy, std::void_t<decltype(Policy::kBlockAlignment)>>
+    : std::integral_constant<size_t, std::max(Policy::kBlockAlignment,
+                                              alignof(typename Policy::RefCounts))> {};
+
+// Policies whose counts may finish a release on another thread ask the block for a
+// hook to call in that case, along with the block to pass it.
+template <typename Policy, typename = void>
+struct NeedsReleaseHook : std::false_type {};
+
+template <typename Policy>
+struct NeedsReleaseHook<Policy, std::void_t<decltype(&Policy::RefCounts::SetReleaseHook)>>
+    : std::true_type {};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <thread>
+
+// TSan does not model `std::atomic_thread_fence`, so under it the fences below are
+// replaced with sequentially consistent read-modify-writes that it does see
+#if defined(__SANITIZE_THREAD__)
+#define SMART_POINTERS_EPOCH_RMW_ORDER 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SMART_POINTERS_EPOCH_RMW_ORDER 1
+#endif
+#endif
+
+// Epoch-based protection for read-mostly data, as in RCU.
+//
+// Every thread that reads owns a slot on a cache line of its own. Entering a read section
+// copies the global epoch into the slot and leaving clears it, so readers never write
+// memory that other threads write. A writer that has unlinked an old version calls
+// `Advance`, and may free the version once `OldestReader()` is past the epoch returned.
+//
+// There is one domain per process. Slots are registered on a thread's first read, handed
+// back when the thread exits and reused by later threads; they are never freed.
+class EpochDomain {
+public:
+    static EpochDomain& Global() {
+        static EpochDomain* domain = new EpochDomain;
+        return *domain;
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Wait-free once the calling thread has a slot. Sections may nest.
+    void Enter() {
+        Slot& slot = LocalSlot();
+        if (slot.nesting++ == 0) {
+            // Pairs with `Advance`: either the writer sees this slot, or this thread sees
+            // everything the writer unlinked before advancing
+#ifdef SMART_POINTERS_EPOCH_RMW_ORDER
+            slot.epoch.exchange(epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+#else
+            slot.epoch.store(epoch_.load(std::memory_order_acquire), std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+        }
+    }
+    void Leave() {
+        Slot& slot = LocalSlot();
+        if (--slot.nesting == 0) {
+            slot.epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // Starts a new epoch and returns the one that ended
+    uint64_t Advance() {
+#ifdef SMART_POINTERS_EPOCH_RMW_ORDER
+        return epoch_.fetch_add(1, std::memory_order_seq_cst);
+#else
+        uint64_t ended = epoch_.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return ended;
+#endif
+    }
+
+    // The earliest epoch a reader is still in, or the maximum value if nobody reads.
+    // Data unlinked before `Advance` returned `e` is unreachable once this exceeds `e`.
+    uint64_t OldestReader() const {
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for (Slot* slot = slots_.load(std::memory_order_acquire); slot != nullptr;
+             slot = slot->next) {
+            uint64_t entered = slot->epoch.load(std::memory_order_acquire);
+            if (entered != 0 && entered < oldest) {
+                oldest = entered;
+            }
+        }
+        return oldest;
+    }
+
+    // Blocks until every reader has left the sections entered up to `epoch`
+    void WaitFor(uint64_t epoch) const {
+        while (OldestReader() <= epoch) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch = 0;  // 0 outside read sections
+        std::atomic<bool> taken = true;
+        size_t nesting = 0;  // only touched by the owning thread
+        Slot* next = nullptr;
+    };
+
+    // Hands the slot back at thread exit. A thread that reads again while exiting gets a
+    // slot that stays taken.
+    struct Releaser {
+        Slot*& slot;
+        ~Releaser() {
+            slot->taken.store(false, std::memory_order_release);
+            slot = nullptr;
+        }
+    };
+
+    EpochDomain() = default;
+
+    Slot& LocalSlot() {
+        static thread_local Slot* slot = nullptr;
+        if (slot == nullptr) {
+            slot = AcquireSlot();
+            static thread_local Releaser releaser{slot};
+        }
+        return *slot;
+    }
+
+    Slot* AcquireSlot() {
+        Slot* head = slots_.load(std::memory_order_acquire);
+        for (Slot* slot = head; slot != nullptr; slot = slot->next) {
+            bool taken = false;
+            if (!slot->taken.load(std::memory_order_relaxed) &&
+                slot->taken.compare_exchange_strong(taken, true, std::memory_order_acquire)) {
+                return slot;
+            }
+        }
+        auto* slot = new Slot;
+        slot->next = head;
+        while (!slots_.compare_exchange_weak(slot->next, slot, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+        }
+        return slot;
+    }
+
+    std::atomic<uint64_t> epoch_ = 1;  // 0 marks an empty slot
+    std::atomic<Slot*> slots_ = nullptr;
+};
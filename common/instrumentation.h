@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Per-type counters of smart pointer operations.
+//
+// Define SMART_POINTERS_INSTRUMENTATION (consistently for the whole program) to make
+// `UniquePtr`, `SharedPtr`, `WeakPtr` and `IntrusivePtr` report their operations,
+// keyed by pointee type. Every thread bumps its own counters with plain stores; a
+// snapshot sums them over all live threads and the ones that have already exited.
+// Without the macro `RecordPtrEvent` is empty and snapshots contain no types.
+
+enum class PtrEvent {
+    kCopy,
+    kMove,
+    kLock,            // `WeakPtr::Lock()` and promotions of a `WeakPtr` to a `SharedPtr`
+    kLockFailed,      // ... that found the object expired
+    kBlockAllocated,  // control block, or the object itself for `MakeIntrusive`
+    kDestroyed,       // the pointee was destroyed by its last owner
+    kCount
+};
+
+struct PtrTypeStats {
+    static constexpr size_t kEventCount = static_cast<size_t>(PtrEvent::kCount);
+
+    uint64_t Get(PtrEvent event) const {
+        return events[static_cast<size_t>(event)];
+    }
+    uint64_t Total() const {
+        uint64_t total = 0;
+        for (uint64_t count : events) {
+            total += count;
+        }
+        return total;
+    }
+
+    std::string type;
+    uint64_t events[kEventCount] = {};
+};
+
+class PtrStats {
+public:
+    // Types past this limit are all counted under "(other)"
+    static constexpr size_t kMaxTypes = 256;
+    static constexpr size_t kEventCount = PtrTypeStats::kEventCount;
+
+    template <typename T>
+    static void Record(PtrEvent event) {
+        static const size_t slot = RegisterType(ParseTypeName(RawTypeName<T>()));
+        ThreadCounters& counters = LocalCounters();
+        if (!counters.registered || counters.exited) {
+            return RecordSlow(counters, slot, event);
+        }
+        Bump(counters.events[slot][static_cast<size_t>(event)]);
+    }
+
+    // Types that have seen any event, hottest first
+    static std::vector<PtrTypeStats> Snapshot() {
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        std::vector<PtrTypeStats> snapshot(registry.names.size());
+        for (size_t slot = 0; slot < snapshot.size(); ++slot) {
+            snapshot[slot].type = registry.names[slot];
+            for (size_t event = 0; event < kEventCount; ++event) {
+                uint64_t total = registry.retired[slot][event];
+                for (const ThreadCounters* counters : registry.threads) {
+                    total += counters->events[slot][event].load(std::memory_order_relaxed);
+                }
+                snapshot[slot].events[event] = total;
+            }
+        }
+        snapshot.erase(std::remove_if(snapshot.begin(), snapshot.end(),
+                                      [](const PtrTypeStats& stats) { return stats.Total() == 0; }),
+                       snapshot.end());
+        std::stable_sort(snapshot.begin(), snapshot.end(),
+                         [](const PtrTypeStats& left, const PtrTypeStats& right) {
+                             return left.Total() > right.Total();
+                         });
+        return snapshot;
+    }
+
+    static const char* EventName(PtrEvent event) {
+        static constexpr const char* kNames[kEventCount] = {
+            "copies", "moves", "locks", "failed_locks", "blocks_allocated", "destroyed"};
+        return kNames[static_cast<size_t>(event)];
+    }
+
+    // One row per type, columns aligned
+    static std::string ToText(const std::vector<PtrTypeStats>& snapshot) {
+        size_t width = 4;
+        for (const PtrTypeStats& stats : snapshot) {
+            width = std::max(width, stats.type.size());
+        }
+        std::string text = Pad("type", width);
+        for (size_t event = 0; event < kEventCount; ++event) {
+            text += "  ";
+            text += EventName(static_cast<PtrEvent>(event));
+        }
+        text += '\n';
+        for (const PtrTypeStats& stats : snapshot) {
+            text += Pad(stats.type, width);
+            for (size_t event = 0; event < kEventCount; ++event) {
+                std::string count = std::to_string(stats.events[event]);
+                size_t column = std::string_view(EventName(static_cast<PtrEvent>(event))).size();
+                text += "  ";
+                text.append(column > count.size() ? column - count.size() : 0, ' ');
+                text += count;
+            }
+            text += '\n';
+        }
+        return text;
+    }
+
+    // {"types": [{"type": "Foo", "copies": 1, ...}, ...]}
+    static std::string ToJson(const std::vector<PtrTypeStats>& snapshot) {
+        std::string json = "{\"types\": [";
+        for (size_t i = 0; i < snapshot.size(); ++i) {
+            json += i == 0 ? "{" : ", {";
+            json += "\"type\": \"";
+            for (char c : snapshot[i].type) {
+                if (c == '"' || c == '\\') {
+                    json += '\\';
+                }
+                json += c;
+            }
+            json += '"';
+            for (size_t event = 0; event < kEventCount; ++event) {
+                json += ", \"";
+                json += EventName(static_cast<PtrEvent>(event));
+                json += "\": ";
+                json += std::to_string(snapshot[i].events[event]);
+            }
+            json += '}';
+        }
+        json += "]}";
+        return json;
+    }
+
+private:
+    // Trivially destructible, so it stays usable while other thread_local objects are
+    // being destroyed; `Reaper` folds it into the registry at thread exit.
+    struct ThreadCounters {
+        std::atomic<uint64_t> events[kMaxTypes][kEventCount];
+        bool registered = false;
+        bool exited = false;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::string> names;
+        std::vector<ThreadCounters*> threads;
+        uint64_t retired[kMaxTypes][kEventCount] = {};  // threads that have already exited
+    };
+
+    struct Reaper {
+        ~Reaper() {
+            ThreadCounters& counters = LocalCounters();
+            Registry& registry = GetRegistry();
+            std::lock_guard lock(registry.mutex);
+            for (size_t slot = 0; slot < kMaxTypes; ++slot) {
+                for (size_t event = 0; event < kEventCount; ++event) {
+                    registry.retired[slot][event] +=
+                        counters.events[slot][event].load(std::memory_order_relaxed);
+                }
+            }
+            registry.threads.erase(
+                std::find(registry.threads.begin(), registry.threads.end(), &counters));
+            counters.exited = true;
+        }
+    };
+
+    template <typename T>
+    static const char* RawTypeName() {
+#if defined(__GNUC__)
+        return __PRETTY_FUNCTION__;
+#else
+        return __FUNCSIG__;
+#endif
+    }
+
+    // "static const char* PtrStats::RawTypeName() [with T = Foo]" (GCC) or
+    // "static const char *PtrStats::RawTypeName() [T = Foo]" (Clang) -> "Foo"
+    static std::string ParseTypeName(std::string_view name) {
+        size_t begin = name.find("T = ");
+        size_t end = name.rfind(']');
+        if (begin == std::string_view::npos || end == std::string_view::npos || end < begin) {
+            return std::string(name);
+        }
+        begin += 4;
+        return std::string(name.substr(begin, end - begin));
+    }
+
+    static std::string Pad(const std::string& text, size_t width) {
+        return text + std::string(width - text.size(), ' ');
+    }
+
+    // Only the owning thread writes its counters, so a plain store is enough
+    static void Bump(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static ThreadCounters& LocalCounters() {
+        static thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    // Never destroyed: pointers may still be released during static destruction
+    static Registry& GetRegistry() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    static size_t RegisterType(std::string name) {
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        if (registry.names.size() == kMaxTypes - 1) {
+            registry.names.push_back("(other)");
+        }
+        if (registry.names.size() == kMaxTypes) {
+            return kMaxTypes - 1;
+        }
+        registry.names.push_back(std::move(name));
+        return registry.names.size() - 1;
+    }
+
+    static void RecordSlow(ThreadCounters& counters, size_t slot, PtrEvent event) {
+        Registry& registry = GetRegistry();
+        if (!counters.exited) {
+            static thread_local Reaper reaper;
+            std::lock_guard lock(registry.mutex);
+            registry.threads.push_back(&counters);
+            counters.registered = true;
+        } else {
+            std::lock_guard lock(registry.mutex);
+            ++registry.retired[slot][static_cast<size_t>(event)];
+            return;
+        }
+        Bump(counters.events[slot][static_cast<size_t>(event)]);
+    }
+};
+
+// Called by the pointer headers; compiles to nothing unless instrumentation is enabled
+template <typename T>
+inline void RecordPtrEvent([[maybe_unused]] PtrEvent event) {
+#ifdef SMART_POINTERS_INSTRUMENTATION
+    PtrStats::Record<std::remove_cv_t<T>>(event);
+#endif
+}
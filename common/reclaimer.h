@@ -0,0 +1,169 @@
+#pragma once
+
+#include <common/counter_policy.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A background thread that runs deferred releases, so that the thread dropping the last
+// reference to a large object graph does not pay for its destructor.
+//
+// Work goes through a bounded ring buffer. When it is full, `Submit` either waits for a
+// free slot (`kBlock`) or runs the task itself (`kRunInline`). Tasks submitted from the
+// reclaimer thread, e.g. by a destructor releasing further reclaimed pointers, run inline
+// so that the thread never waits on itself.
+class Reclaimer {
+public:
+    enum class Backpressure { kBlock, kRunInline };
+
+    static constexpr size_t kDefaultCapacity = 1024;
+
+    explicit Reclaimer(size_t capacity = kDefaultCapacity,
+                       Backpressure backpressure = Backpressure::kBlock)
+        : tasks_(capacity), backpressure_(backpressure), thread_([this] { Run(); }){};
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+    ~Reclaimer() {
+        Stop();
+    }
+
+    // The instance used by the `Reclaimed` policy. Stopped at exit, before the static
+    // objects constructed ahead of it are destroyed; later releases run inline.
+    static Reclaimer& Default() {
+        static Reclaimer* instance = [] {
+            auto* reclaimer = new Reclaimer();
+            std::atexit([] { Default().Stop(); });
+            return reclaimer;
+        }();
+        return *instance;
+    }
+
+    void Submit(void (*run)(void*), void* argument) {
+        {
+            std::unique_lock lock(mutex_);
+            if (!stopped_ && std::this_thread::get_id() != thread_.get_id()) {
+                if (backpressure_ == Backpressure::kBlock) {
+                    not_full_.wait(lock, [this] { return size_ < tasks_.size() || stopped_; });
+                }
+                if (size_ < tasks_.size() && !stopped_) {
+                    tasks_[(head_ + size_) % tasks_.size()] = {run, argument};
+                    ++size_;
+                    not_empty_.notify_one();
+                    return;
+                }
+            }
+        }
+        run(argument);
+    }
+
+    // Waits until every task submitted so far has run
+    void Drain() {
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] { return (size_ == 0 && !running_) || stopped_; });
+    }
+
+    // Drains the queue and joins the thread; `Submit` runs tasks inline from then on
+    void Stop() {
+        {
+            std::unique_lock lock(mutex_);
+            if (stopping_) {
+                idle_.wait(lock, [this] { return stopped_; });
+                return;
+            }
+            stopping_ = true;
+            not_empty_.notify_one();
+        }
+        thread_.join();
+    }
+
+    size_t Pending() const {
+        std::lock_guard lock(mutex_);
+        return size_ + running_;
+    }
+
+private:
+    struct Task {
+        void (*run)(void*) = nullptr;
+        void* argument = nullptr;
+    };
+
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            not_empty_.wait(lock, [this] { return size_ != 0 || stopping_; });
+            if (size_ == 0) {
+                break;
+            }
+            Task task = tasks_[head_];
+            head_ = (head_ + 1) % tasks_.size();
+            --size_;
+            running_ = true;
+            not_full_.notify_one();
+            lock.unlock();
+            task.run(task.argument);
+            lock.lock();
+            running_ = false;
+            if (size_ == 0) {
+                idle_.notify_all();
+            }
+        }
+        stopped_ = true;
+        not_full_.notify_all();
+        idle_.notify_all();
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::condition_variable idle_;
+    std::vector<Task> tasks_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    bool running_ = false;
+    bool stopping_ = false;
+    bool stopped_ = false;
+    Backpressure backpressure_;
+    std::thread thread_;
+};
+
+// Counts that hand the last release of a block (the object's destructor, then freeing the
+// block once no weak references are left) to `Reclaimer::Default()` instead of running it
+// in the thread that dropped the last strong reference. `Base` does the counting.
+template <typename Base = MultiThreaded>
+struct Reclaimed {
+    // The weak count is released on the reclaimer thread
+    static_assert(Base::kThreadSafe, "Base must be thread-safe");
+    static_assert(!NeedsReleaseHook<Base>::value, "Base must release blocks itself");
+
+    static constexpr bool kThreadSafe = Base::kThreadSafe;
+
+    class RefCounts : public Base::RefCounts {
+    public:
+        bool DecStrong() {
+            if (Base::RefCounts::DecStrong()) {
+                Reclaimer::Default().Submit(release_, block_);
+            }
+            return false;
+        }
+        bool SubStrong(size_t count) {
+            if (Base::RefCounts::SubStrong(count)) {
+                Reclaimer::Default().Submit(release_, block_);
+            }
+            return false;
+        }
+
+        void SetReleaseHook(void (*release)(void*), void* block) {
+            release_ = release;
+            block_ = block;
+        }
+
+    private:
+        void (*release_)(void*) = nullptr;
+        void* block_ = nullptr;
+    };
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "intrusive.h"
+
+#include <common/arena.h>
+#include <common/instrumentation.h>
+
+#include <cstddef>  // for std::nullptr_t
+#include <cstdint>
+#include <stdexcept>
+#include <utility>  // for std::swap
+
+// `IntrusivePtr` in 4 bytes: the object is kept as a 32-bit offset into `Arena`, which is
+// where `MakeCompactIntrusive` places it. Objects release their memory through
+// `ArenaDelete<Arena>`, e.g. `struct Node : SimpleRefCounted<Node, ArenaDelete<A>>`.
+template <typename T, typename Arena>
+class CompactIntrusivePtr {
+public:
+    // Constructors
+    CompactIntrusivePtr() = default;
+    CompactIntrusivePtr(std::nullptr_t){};
+    // Throws `std::invalid_argument` if `ptr` is not an aligned address inside `Arena`
+    CompactIntrusivePtr(T* ptr) {
+        if (!Arena::Addressable(ptr)) {
+            throw std::invalid_argument("CompactIntrusivePtr: pointer outside the arena");
+        }
+        offset_ = Arena::ToOffset(ptr);
+        if (ptr != nullptr) {
+            ptr->IncRef();
+        }
+    };
+    CompactIntrusivePtr(const CompactIntrusivePtr& other) : offset_(other.offset_) {
+        if (T* ptr = Get()) {
+            ptr->IncRef();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+    CompactIntrusivePtr(CompactIntrusivePtr&& other) noexcept : offset_(other.offset_) {
+        other.offset_ = 0;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    }
+
+    // `operator=`-s
+    CompactIntrusivePtr& operator=(const CompactIntrusivePtr& other) {
+        CompactIntrusivePtr(other).Swap(*this);
+        return *this;
+    }
+    CompactIntrusivePtr& operator=(CompactIntrusivePtr&& other) noexcept {
+        CompactIntrusivePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    // Destructor
+    ~CompactIntrusivePtr() {
+        Reset();
+    }
+
+    // Modifiers
+    void Reset() {
+        if (T* ptr = Get()) {
+            offset_ = 0;
+            ptr->DecRef();
+        }
+    }
+    void Reset(T* ptr) {
+        CompactIntrusivePtr(ptr).Swap(*this);
+    }
+    void Swap(CompactIntrusivePtr& other) noexcept {
+        std::swap(offset_, other.offset_);
+    }
+
+    // Observers
+    T* Get() const {
+        return Arena::template FromOffset<T>(offset_);
+    }
+    T& operator*() const {
+        return *Get();
+    }
+    T* operator->() const {
+        return Get();
+    }
+    size_t UseCount() const {
+        if (offset_ == 0) {
+            return 0;
+        }
+        return Get()->RefCount();
+    }
+    explicit operator bool() const {
+        return offset_ != 0;
+    }
+
+private:
+    uint32_t offset_ = 0;
+};
+
+template <typename T, typename Arena, typename... Args>
+CompactIntrusivePtr<T, Arena> MakeCompactIntrusive(Args&&... args) {
+    static_assert(alignof(T) <= Arena::kAlignment, "over-aligned types do not fit");
+    void* memory = Arena::Allocate(sizeof(T));
+    T* object;
+    try {
+        object = new (memory) T(std::forward<Args>(args)...);
+    } catch (...) {
+        Arena::Deallocate(memory, sizeof(T));
+        throw;
+    }
+    RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+    return CompactIntrusivePtr<T, Arena>(object);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <common/instrumentation.h>
+
 #include <cstddef>  // for std::nullptr_t
 #include <utility>  // for std::exchange / std::swap
 
@@ -42,6 +44,7 @@ public:
     void DecRef() {
         counter_.DecRef();
         if (counter_.RefCount() == 0) {
+            RecordPtrEvent<Derived>(PtrEvent::kDestroyed);
             Deleter::Destroy(static_cast<Derived*>(this));
         }
     }
@@ -87,6 +90,7 @@ public:
                 ptr_->IncRef();
             }
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
 
     template <typename Y>
@@ -99,6 +103,7 @@ public:
             }
             other.Reset();
         }
+        RecordPtrEvent<T>(PtrEvent::kMove);
     }
 
     IntrusivePtr(const IntrusivePtr& other) {
@@ -109,6 +114,7 @@ public:
                 ptr_->IncRef();
             }
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
     IntrusivePtr(IntrusivePtr&& other) {
         if (ptr_ != other.ptr_) {
@@ -119,6 +125,7 @@ public:
             }
             other.Reset();
         }
+        RecordPtrEvent<T>(PtrEvent::kMove);
     }
 
     // `operator=`-s
@@ -130,6 +137,7 @@ public:
                 ptr_->IncRef();
             }
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
         return *this;
     }
     IntrusivePtr& operator=(IntrusivePtr&& other) {
@@ -141,6 +149,7 @@ public:
             }
             other.ptr_ = nullptr;
         }
+        RecordPtrEvent<T>(PtrEvent::kMove);
         return *this;
     }
 
@@ -153,6 +162,7 @@ public:
                 ptr_->IncRef();
             }
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
         return *this;
     }
 
@@ -205,6 +215,7 @@ private:
 
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+    RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
     IntrusivePtr<T> result = new T(std::forward<Args>(args)...);
     return result;
 }
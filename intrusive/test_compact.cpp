@@ -0,0 +1,123 @@
+#include "compact_intrusive.h"
+
+#include <catch.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct CompactTestTag {};
+using TestArena = Arena<CompactTestTag, size_t(1) << 24>;
+
+struct CompactNode : public SimpleRefCounted<CompactNode, ArenaDelete<TestArena>> {
+    CompactNode(int value) : value{value} {
+    }
+
+    int value = 0;
+    CompactIntrusivePtr<CompactNode, TestArena> next;
+};
+
+using NodePtr = CompactIntrusivePtr<CompactNode, TestArena>;
+
+struct CompactString : public SimpleRefCounted<CompactString, ArenaDelete<TestArena>>,
+                       public std::string {
+    using std::string::basic_string;
+};
+
+TEST_CASE("Compact empty") {
+    SECTION("Sizeof") {
+        REQUIRE(sizeof(NodePtr) == 4);
+    }
+
+    SECTION("Empty state") {
+        NodePtr a, b;
+
+        b = a;
+        NodePtr c(a);
+        b = std::move(c);
+
+        REQUIRE(a.Get() == nullptr);
+        REQUIRE(b.Get() == nullptr);
+        REQUIRE(c.Get() == nullptr);
+        REQUIRE(a.UseCount() == 0);
+        REQUIRE(!a);
+    }
+}
+
+TEST_CASE("Compact copy/move") {
+    using StringPtr = CompactIntrusivePtr<CompactString, TestArena>;
+
+    SECTION("Constructors") {
+        StringPtr a = MakeCompactIntrusive<CompactString, TestArena>("abacaba");
+        StringPtr b = a;
+        StringPtr c = std::move(a);
+        StringPtr d = b;
+        REQUIRE(c.UseCount() == 3);
+        REQUIRE(!a);
+        REQUIRE(*b == "abacaba");
+        REQUIRE(*c == "abacaba");
+        REQUIRE(*d == "abacaba");
+    }
+
+    SECTION("Assignment") {
+        StringPtr a = MakeCompactIntrusive<CompactString, TestArena>("abracadabra");
+        StringPtr b = MakeCompactIntrusive<CompactString, TestArena>("karabas");
+        StringPtr c = b;
+        b = a;
+        a = b;
+        c = std::move(a);
+        REQUIRE(b.UseCount() == 2);
+        REQUIRE(*c == "abracadabra");
+        REQUIRE(!a);
+    }
+
+    SECTION("Reset and swap") {
+        StringPtr a = MakeCompactIntrusive<CompactString, TestArena>("a");
+        StringPtr b = a;
+        a.Reset();
+        REQUIRE(!a);
+        REQUIRE(b.UseCount() == 1);
+
+        a.Reset(b.Get());
+        REQUIRE(a.Get() == b.Get());
+        REQUIRE(b.UseCount() == 2);
+
+        StringPtr c = MakeCompactIntrusive<CompactString, TestArena>("c");
+        a.Swap(c);
+        REQUIRE(*a == "c");
+        REQUIRE(*c == "a");
+    }
+}
+
+TEST_CASE("Compact memory is reused") {
+    NodePtr list = MakeCompactIntrusive<CompactNode, TestArena>(1);
+    list->next = MakeCompactIntrusive<CompactNode, TestArena>(2);
+    list->next->next = MakeCompactIntrusive<CompactNode, TestArena>(3);
+    REQUIRE(TestArena::Contains(list->next->next.Get()));
+    REQUIRE(list->next->next->value == 3);
+
+    CompactNode* second = list->next.Get();
+    list->next = nullptr;  // releases the second and the third nodes
+    size_t used = TestArena::Used();
+
+    NodePtr reused = MakeCompactIntrusive<CompactNode, TestArena>(4);
+    REQUIRE(TestArena::Used() == used);
+    NodePtr other = MakeCompactIntrusive<CompactNode, TestArena>(5);
+    REQUIRE(TestArena::Used() == used);
+    REQUIRE((reused.Get() == second || other.Get() == second));
+}
+
+TEST_CASE("Compact rejects pointers outside the arena") {
+    auto heap = std::make_unique<CompactNode>(1);
+    REQUIRE_THROWS_AS(NodePtr(heap.get()), std::invalid_argument);
+    REQUIRE(heap->RefCount() == 0);
+
+    NodePtr node = MakeCompactIntrusive<CompactNode, TestArena>(2);
+    auto* unaligned = reinterpret_cast<CompactNode*>(reinterpret_cast<char*>(node.Get()) + 4);
+    NodePtr other;
+    REQUIRE_THROWS_AS(other.Reset(unaligned), std::invalid_argument);
+    REQUIRE(!other);
+    REQUIRE(node.UseCount() == 1);
+}
@@ -1,167 +1,292 @@
 #pragma once
 
 #include "sw_fwd.h"  // Forward declaration
+#include <common/block_pool.h>
+#include <common/instrumentation.h>
+#include <unique/compressed_pair.h>
+#include <algorithm>
+#include <memory>  // std::allocator_traits
+#include <memory_resource>
+#include <new>  // std::launder / std::align_val_t / std::bad_array_new_length
+#include <type_traits>
 #include <utility>
 #include <cstddef>  // std::nullptr_t
+#include <cstdint>  // SIZE_MAX
 
 class ESFTBase {};
+class CompactESFTBase {};
+class EmbeddedESFTBase {};
 
-struct BaseBlock {
-    virtual void IncStrongCounter() = 0;
-    virtual void IncWeakCounter() = 0;
-    virtual void DecStrongCounter() = 0;
-    virtual void DecWeakCounter() = 0;
-    virtual ~BaseBlock(){};
-    virtual size_t GetStrongCounter() = 0;
-    [[maybe_unused]] virtual size_t& GetWeakCounter() = 0;
-};
-template <typename T>
-struct ControlBlockPointer : BaseBlock {
-    ControlBlockPointer() = default;
-    ControlBlockPointer(T* object) : object_(object), strong_counter_(1){};
-    void DecStrongCounter() override {
-        if (this != nullptr) {
-            if (strong_counter_ > 1) {
-                --strong_counter_;
-            } else if ((strong_counter_ == 1 && weak_counter_ == 0) ||
-                       (strong_counter_ == 0 && weak_counter_ == 0)) {
-                delete object_;
-                delete this;
-            } else if ((strong_counter_ == 0 && weak_counter_ != 0) ||
-                       (weak_counter_ != 0 && strong_counter_ == 1)) {
-                --strong_counter_;
-                delete object_;
-                if (weak_counter_ == 0) {
-                    delete this;
-                }
-            }
+// Operations dispatched through a block's manager: the last-release path, `kGetDeleter`,
+// which returns the stored deleter if its type tag matches, and `kGetObject`, which
+// returns the address of the owned object (the first element for arrays)
+enum class BlockOp { kDestroyObject, kDeallocate, kGetDeleter, kGetObject };
+
+// A unique address per type, compared instead of `typeid` when looking up a deleter
+template <typename D>
+const void* TypeTag() {
+    static constexpr char kTag = 0;
+    return &kTag;
+}
+
+// Counters live directly in the (non-polymorphic) header, so copies, releases
+// and `UseCount()` are inlined; the type-specific part is a single function
+// pointer that is only called once the strong or weak count reaches zero.
+// Blocks are aligned as the policy asks, see `BlockAlignment`.
+template <typename Policy>
+struct alignas(BlockAlignment<Policy>::value) BaseBlock {
+    using Manager = void* (*)(BaseBlock*, BlockOp, const void* type);
+
+    explicit BaseBlock(Manager manager) : manager_(manager) {
+        if constexpr (NeedsReleaseHook<Policy>::value) {
+            counts_.SetReleaseHook(&ReleaseFromHook, this);
         }
-    }
+    };
 
-    void DecWeakCounter() override {
-        if (this != nullptr) {
-            if (weak_counter_ > 1) {
-                --weak_counter_;
-            } else if ((weak_counter_ == 1 && strong_counter_ == 0) ||
-                       (weak_counter_ == 0 && strong_counter_ == 0)) {
-                //                if (!std::is_convertible_v<T*, ESFTBase*>) {
-                delete this;
-                //                }
-            } else if ((weak_counter_ == 1 && strong_counter_ != 0) ||
-                       (weak_counter_ == 0 && strong_counter_ != 0)) {
-                --weak_counter_;
-            }
+    void IncStrongCounter() {
+        counts_.IncStrong();
+    }
+    void IncWeakCounter() {
+        counts_.IncWeak();
+    }
+    // Takes a strong reference unless the object is already gone
+    LockStatus TryIncStrongCounter(bool retry) {
+        return counts_.TryIncStrong(retry);
+    }
+    void DecStrongCounter() {
+        if (counts_.DecStrong()) {
+            ReleaseObject();
         }
     }
-
-    void IncStrongCounter() override {
-        ++strong_counter_;
+    // `count` strong references in one update, for bulk copies and releases
+    void AddStrongCounter(size_t count) {
+        counts_.AddStrong(count);
     }
-
-    void IncWeakCounter() override {
-        ++weak_counter_;
+    void SubStrongCounter(size_t count) {
+        if (counts_.SubStrong(count)) {
+            ReleaseObject();
+        }
     }
-
-    size_t GetStrongCounter() override {
-        return strong_counter_;
+    // Runs once the last strong reference is gone
+    void ReleaseObject() {
+        manager_(this, BlockOp::kDestroyObject, nullptr);
+        // Drop the weak reference held on behalf of the strong owners
+        DecWeakCounter();
+    }
+    // The release hook of policies that may finish a release on another thread
+    static void ReleaseFromHook(void* block) {
+        static_cast<BaseBlock*>(block)->ReleaseObject();
     }
-    size_t& GetWeakCounter() override {
-        return weak_counter_;
+    void DecWeakCounter() {
+        if (counts_.DecWeak()) {
+            manager_(this, BlockOp::kDeallocate, nullptr);
+        }
+    }
+    size_t GetStrongCounter() const {
+        return counts_.Strong();
+    }
+    // Whether the caller's reference is the only strong one, for copy-on-write
+    bool HasUniqueStrong() const {
+        return counts_.UniqueStrong();
     }
-    ~ControlBlockPointer() {
-        object_ = nullptr;
-        strong_counter_ = 0;
-        weak_counter_ = 0;
+    [[maybe_unused]] size_t GetWeakCounter() const {
+        return counts_.Weak() - (counts_.Strong() != 0);
     }
-    T* object_ = nullptr;
-    size_t strong_counter_ = 0;
-    size_t weak_counter_ = 0;
+
+    Manager manager_;
+    typename Policy::RefCounts counts_;
 };
-template <typename T>
-struct ControlBlockObject : BaseBlock {
-    ControlBlockObject(T object) : strong_counter_(1) {
-        new (&buffer_) T(object);
+// The deleter is stored next to the pointer; an empty one takes no space.
+// `T` may be an array type, in which case the default deleter calls `delete[]`.
+template <typename T, typename Policy, typename Deleter = std::default_delete<T>>
+struct ControlBlockPointer : BaseBlock<Policy> {
+    using Element = std::remove_extent_t<T>;
+
+    ControlBlockPointer(Element* object) : BaseBlock<Policy>(&Manage), object_(object, Deleter()) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
     };
+    // Moves from `deleter` only once the memory for the block has been obtained
+    ControlBlockPointer(Element* object, Deleter& deleter)
+        : BaseBlock<Policy>(&Manage), object_(object, std::move(deleter)) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+    };
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void* type) {
+        auto* self = static_cast<ControlBlockPointer*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            self->object_.GetSecond()(self->object_.GetFirst());
+        } else if (op == BlockOp::kDeallocate) {
+            DeleteBlock(self);
+        } else if (op == BlockOp::kGetObject) {
+            return const_cast<std::remove_cv_t<Element>*>(self->object_.GetFirst());
+        } else if (type == TypeTag<Deleter>()) {
+            return &self->object_.GetSecond();
+        }
+        return nullptr;
+    }
+    CompressedPair<Element*, Deleter> object_;
+};
+template <typename T, typename Policy>
+struct ControlBlockObject : BaseBlock<Policy> {
     template <typename... Args>
-    ControlBlockObject(Args&&... args) : strong_counter_(1) {
-        new (&buffer_) T(std::forward<Args>(args)...);
+    ControlBlockObject(Args&&... args) : BaseBlock<Policy>(&Manage) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+        ::new (static_cast<void*>(&buffer_)) T(std::forward<Args>(args)...);
     };
-    void DecStrongCounter() override {
-        if (this != nullptr) {
-            if (strong_counter_ > 1) {
-                --strong_counter_;
-            } else if ((strong_counter_ == 1 && weak_counter_ == 0) ||
-                       (strong_counter_ == 0 && weak_counter_ == 0)) {
-                reinterpret_cast<T*>(&buffer_)->~T();
-                delete this;
-            } else if ((strong_counter_ == 0 && weak_counter_ != 0) ||
-                       (weak_counter_ != 0 && strong_counter_ == 1)) {
-                --strong_counter_;
-                reinterpret_cast<T*>(&buffer_)->~T();
-                if (weak_counter_ == 0) {
-                    delete this;
-                }
-            }
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockObject*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            reinterpret_cast<T*>(&self->buffer_)->~T();
+        } else if (op == BlockOp::kDeallocate) {
+            DeleteBlock(self);
+        } else if (op == BlockOp::kGetObject) {
+            return &self->buffer_;
         }
+        return nullptr;
     }
+    // Aligned as the block too, so that a line-aligned header does not share its last
+    // line with the object
+    alignas(std::max(alignof(T), BlockAlignment<Policy>::value)) unsigned char buffer_[sizeof(T)];
+};
 
-    void DecWeakCounter() override {
-        if (this != nullptr) {
-            if (weak_counter_ > 1) {
-                --weak_counter_;
-            }
-            if ((weak_counter_ == 1 && strong_counter_ == 0) ||
-                (weak_counter_ == 0 && strong_counter_ == 0)) {
-                //                if (!std::is_convertible_v<T*, ESFTBase*>) {
-                delete this;
-                //                }
-            } else if ((weak_counter_ == 1 && strong_counter_ != 0) ||
-                       (weak_counter_ == 0 && strong_counter_ != 0)) {
-                --weak_counter_;
+// `MakeShared<T[]>` block: the header, the length and the elements share one allocation,
+// with the elements starting at the first suitably aligned offset past the header
+template <typename T, typename Policy>
+struct ControlBlockArray : BaseBlock<Policy> {
+    explicit ControlBlockArray(size_t size) : BaseBlock<Policy>(&Manage), size_(size) {
+        RecordPtrEvent<T[]>(PtrEvent::kBlockAllocated);
+    };
+
+    template <typename... Value>
+    static ControlBlockArray* Create(size_t size, const Value&... value) {
+        // A wrapped size would allocate a short block and construct past its end
+        if (size > (SIZE_MAX - ElementsOffset()) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* memory = AllocateBlock(AllocationSize(size), Alignment());
+        auto* block = new (memory) ControlBlockArray(size);
+        size_t constructed = 0;
+        try {
+            for (; constructed < size; ++constructed) {
+                // `T(value...)` value-initializes when no value is given
+                ::new (static_cast<void*>(block->Elements() + constructed)) T(value...);
             }
+        } catch (...) {
+            block->DestroyElements(constructed);
+            block->~ControlBlockArray();
+            DeallocateBlock(memory, AllocationSize(size), Alignment());
+            throw;
+        }
+        return block;
+    }
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockArray*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T[]>(PtrEvent::kDestroyed);
+            self->DestroyElements(self->size_);
+        } else if (op == BlockOp::kDeallocate) {
+            size_t bytes = AllocationSize(self->size_);
+            self->~ControlBlockArray();
+            DeallocateBlock(self, bytes, Alignment());
+        } else if (op == BlockOp::kGetObject) {
+            return const_cast<std::remove_cv_t<T>*>(self->Elements());
         }
+        return nullptr;
     }
 
-    void IncStrongCounter() override {
-        ++strong_counter_;
+    static constexpr size_t Alignment() {
+        return std::max(alignof(ControlBlockArray), alignof(T));
     }
-    void IncWeakCounter() override {
-        ++weak_counter_;
+    static constexpr size_t ElementsOffset() {
+        return (sizeof(ControlBlockArray) + alignof(T) - 1) / alignof(T) * alignof(T);
     }
-
-    size_t GetStrongCounter() override {
-        return strong_counter_;
+    static size_t AllocationSize(size_t size) {
+        return ElementsOffset() + size * sizeof(T);
     }
-    size_t& GetWeakCounter() override {
-        return weak_counter_;
+    T* Elements() {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + ElementsOffset());
     }
-    ~ControlBlockObject() {
-        strong_counter_ = 0;
-        weak_counter_ = 0;
+    // Reverse order of construction, as for built-in arrays
+    void DestroyElements(size_t count) {
+        for (size_t i = count; i > 0; --i) {
+            std::destroy_at(Elements() + i - 1);
+        }
     }
-    std::aligned_storage_t<sizeof(T), alignof(T)> buffer_;
-    size_t strong_counter_ = 0;
-    size_t weak_counter_ = 0;
+
+    size_t size_;
 };
 
+// `AllocateShared` block: the object and the rebound allocator that owns the memory
+template <typename T, typename Alloc, typename Policy>
+struct ControlBlockAllocated : BaseBlock<Policy> {
+    using BlockAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<ControlBlockAllocated>;
+    using ObjectAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+
+    template <typename... Args>
+    ControlBlockAllocated(const BlockAllocator& allocator, Args&&... args)
+        : BaseBlock<Policy>(&Manage), allocator_(allocator) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+        ObjectAllocator object_allocator(allocator_);
+        std::allocator_traits<ObjectAllocator>::construct(
+            object_allocator, reinterpret_cast<std::remove_cv_t<T>*>(&buffer_),
+            std::forward<Args>(args)...);
+    };
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockAllocated*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            ObjectAllocator object_allocator(self->allocator_);
+            std::allocator_traits<ObjectAllocator>::destroy(
+                object_allocator, reinterpret_cast<std::remove_cv_t<T>*>(&self->buffer_));
+        } else if (op == BlockOp::kDeallocate) {
+            BlockAllocator allocator(std::move(self->allocator_));
+            self->~ControlBlockAllocated();
+            std::allocator_traits<BlockAllocator>::deallocate(allocator, self, 1);
+        } else if (op == BlockOp::kGetObject) {
+            return &self->buffer_;
+        }
+        return nullptr;
+    }
+    [[no_unique_address]] BlockAllocator allocator_;
+    alignas(std::max(alignof(T), BlockAlignment<Policy>::value)) unsigned char buffer_[sizeof(T)];
+};
+
+// Points the `EnableSharedFromThis` or `CompactEnableSharedFromThis` base of a newly owned
+// object, if it has one, at the block that owns it
+template <typename Object, typename Policy>
+void LinkSharedFromThis(Object* object, BaseBlock<Policy>* block) {
+    if constexpr (std::is_convertible_v<Object*, ESFTBase*>) {
+        object->weak_this.block_ = block;
+        object->weak_this.observed_ = object;
+        block->IncWeakCounter();
+    } else if constexpr (std::is_convertible_v<Object*, CompactESFTBase*>) {
+        object->this_block = block;
+    } else if constexpr (std::is_convertible_v<std::remove_cv_t<Object>*, EmbeddedESFTBase*>) {
+        static_assert(sizeof(Object) == 0,
+                      "EmbeddedEnableSharedFromThis objects are owned through SharedPtr(new T) "
+                      "or MakeShared only");
+    }
+}
+
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
-template <typename T>
+template <typename T, typename Policy>
 class SharedPtr {
 public:
+    // `int` for both `SharedPtr<int>` and `SharedPtr<int[]>`
+    using ElementType = std::remove_extent_t<T>;
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
 
     SharedPtr() : block_(nullptr), observed_(nullptr){};
     SharedPtr(std::nullptr_t) : block_(nullptr), observed_(nullptr){};
-    explicit SharedPtr(T* ptr) {
+    explicit SharedPtr(ElementType* ptr) {
         Reset();
         observed_ = ptr;
-        block_ = new ControlBlockPointer<T>(ptr);
-        if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-            ptr->weak_this.block_ = block_;
-            ptr->weak_this.observed_ = ptr;
-            ptr->weak_this.block_->IncWeakCounter();
-        }
+        block_ = AdoptBlock<ControlBlockPointer<T, Policy>>(ptr);
     };
     template <typename S = T>
     SharedPtr(S* ptr) {
@@ -169,94 +294,84 @@ public:
             Reset();
         }
         observed_ = ptr;
-        block_ = new ControlBlockPointer<S>(ptr);
-        if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-            ptr->weak_this.block_ = block_;
-            ptr->weak_this.observed_ = ptr;
-            ptr->weak_this.block_->IncWeakCounter();
-        }
+        block_ = AdoptBlock<ControlBlockPointer<PointerBlockType<S>, Policy>>(ptr);
     };
-    SharedPtr(const SharedPtr& other) {
-        Reset();
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
-        if (other.observed_ != observed_) {
-            observed_ = other.observed_;
-            block_ = other.block_;
+    // One allocation: the deleter is stored inside the block
+    template <typename S, typename D>
+    SharedPtr(S* ptr, D deleter) {
+        observed_ = ptr;
+        block_ = AdoptWithDeleter<DeleterBlockType<S, D>>(ptr, deleter);
+        LinkSharedFromThis(ptr, block_);
+    };
+    SharedPtr(const SharedPtr& other) : block_(other.block_), observed_(other.observed_) {
+        if (block_ != nullptr) {
             block_->IncStrongCounter();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
-    SharedPtr(SharedPtr&& other) {
-        Reset();
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
-        if (other.block_ != nullptr) {
-            block_ = other.block_;
-            observed_ = other.observed_;
+    // Moves hand the reference over without touching the counters
+    SharedPtr(SharedPtr&& other) noexcept : block_(other.block_), observed_(other.observed_) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
+
+    template <typename S>
+    SharedPtr(const SharedPtr<S, Policy>& other)
+        : block_(other.block_), observed_(other.observed_) {
+        if (block_ != nullptr) {
             block_->IncStrongCounter();
-            other.Reset();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     };
-
     template <typename S>
-    SharedPtr(SharedPtr<S> ptr) : observed_(ptr.observed_), block_(ptr.block_) {
-        block_->IncStrongCounter();
+    SharedPtr(SharedPtr<S, Policy>&& other) noexcept
+        : block_(other.block_), observed_(other.observed_) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
     };
 
     // Aliasing constructor
     // #8 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) : observed_(ptr), block_(other.block_) {
-        block_->IncStrongCounter();
+    SharedPtr(const SharedPtr<Y, Policy>& other, ElementType* ptr)
+        : block_(other.block_), observed_(ptr) {
+        if (block_ != nullptr) {
+            block_->IncStrongCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    };
+    template <typename Y>
+    SharedPtr(SharedPtr<Y, Policy>&& other, ElementType* ptr)
+        : block_(other.block_), observed_(ptr) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
     };
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
-    explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Policy>& other) {
+        RecordPtrEvent<T>(PtrEvent::kLock);
+        if (other.block_ == nullptr ||
+            other.block_->TryIncStrongCounter(true) != LockStatus::kLocked) {
+            RecordPtrEvent<T>(PtrEvent::kLockFailed);
             throw BadWeakPtr{};
         }
         block_ = other.block_;
         observed_ = other.observed_;
-        if (block_ != nullptr) {
-            block_->IncStrongCounter();
-        }
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
 
     SharedPtr& operator=(const SharedPtr& other) {
-        if (other.block_ == nullptr) {
-            Reset();
-            block_ = nullptr;
-            observed_ = nullptr;
-            return *this;
-        }
-        if (other.observed_ != observed_) {
-            Reset();
-            observed_ = other.observed_;
-            block_ = other.block_;
-            block_->IncStrongCounter();
-        }
+        SharedPtr(other).Swap(*this);
         return *this;
     }
-    SharedPtr& operator=(SharedPtr&& other) {
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
-        Reset();
-        if (other.block_ != nullptr) {
-            block_ = other.block_;
-            observed_ = other.observed_;
-            block_->IncStrongCounter();
-            other.Reset();
-        }
+    SharedPtr& operator=(SharedPtr&& other) noexcept {
+        SharedPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -281,15 +396,22 @@ public:
     template <typename S>
     void Reset(S* ptr) {
         Reset();
-        block_ = new ControlBlockPointer<S>(ptr);
+        block_ = AdoptBlock<ControlBlockPointer<PointerBlockType<S>, Policy>>(ptr);
         observed_ = ptr;
     }
-    void Reset(T* ptr) {
+    void Reset(ElementType* ptr) {
         Reset();
-        block_ = new ControlBlockPointer<T>(ptr);
+        block_ = AdoptBlock<ControlBlockPointer<T, Policy>>(ptr);
         observed_ = ptr;
     }
-    void Swap(SharedPtr& other) {
+    template <typename S, typename D>
+    void Reset(S* ptr, D deleter) {
+        BaseBlock<Policy>* block = AdoptWithDeleter<DeleterBlockType<S, D>>(ptr, deleter);
+        Reset();
+        block_ = block;
+        observed_ = ptr;
+    }
+    void Swap(SharedPtr& other) noexcept {
         std::swap(block_, other.block_);
         std::swap(observed_, other.observed_);
     }
@@ -297,18 +419,22 @@ public:
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Observers
 
-    T* Get() const {
+    ElementType* Get() const {
         if (block_ == nullptr) {
             return nullptr;
         }
         return observed_;
     }
-    T& operator*() const {
+    ElementType& operator*() const {
         return *observed_;
     }
-    T* operator->() const {
+    ElementType* operator->() const {
         return observed_;
     }
+    ElementType& operator[](std::ptrdiff_t index) const {
+        static_assert(std::is_array_v<T>, "operator[] needs SharedPtr<T[]> or SharedPtr<T[N]>");
+        return observed_[index];
+    }
     size_t UseCount() const {
         if (block_ == nullptr) {
             return 0;
@@ -318,53 +444,408 @@ public:
     explicit operator bool() const {
         return Get() != nullptr;
     }
-    BaseBlock* block_ = nullptr;
-    T* observed_ = nullptr;
+    // The deleter given to the constructor or `Reset`, or nullptr if it is not a `D`
+    template <typename D>
+    D* GetDeleter() const {
+        if (block_ == nullptr) {
+            return nullptr;
+        }
+        return static_cast<D*>(block_->manager_(block_, BlockOp::kGetDeleter, TypeTag<D>()));
+    }
+    BaseBlock<Policy>* block_ = nullptr;
+    ElementType* observed_ = nullptr;
+
+private:
+    // A raw pointer handed to `SharedPtr<T[]>` is released with `delete[]`
+    template <typename S>
+    using PointerBlockType = std::conditional_t<std::is_array_v<T>, T, S>;
+    template <typename S, typename D>
+    using DeleterBlockType = ControlBlockPointer<PointerBlockType<S>, Policy, D>;
+
+    // A new `Block` for a raw pointer, or the block an `EmbeddedEnableSharedFromThis`
+    // object carries
+    template <typename Block, typename S>
+    static BaseBlock<Policy>* AdoptBlock(S* ptr) {
+        using Object = std::remove_cv_t<S>;
+        if constexpr (!std::is_array_v<T> && std::is_convertible_v<Object*, EmbeddedESFTBase*>) {
+            return const_cast<Object*>(ptr)->AdoptEmbeddedBlock(ptr);
+        } else {
+            BaseBlock<Policy>* block = NewBlock<Block>(ptr);
+            LinkSharedFromThis(ptr, block);
+            return block;
+        }
+    }
+
+    // Like `std::shared_ptr`, the object is released with `deleter` if the block
+    // cannot be allocated
+    template <typename Block, typename D>
+    static BaseBlock<Policy>* AdoptWithDeleter(typename Block::Element* ptr, D& deleter) {
+        try {
+            return NewBlock<Block>(ptr, deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+    }
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+template <typename T, typename U, typename Policy>
+inline bool operator==(const SharedPtr<T, Policy>& left, const SharedPtr<U, Policy>& right) {
     return left.block_ == right.block_ && left.observed_ == right.observed_;
 }
 
-// Allocate memory only once
-template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    SharedPtr<T> result;
-    ControlBlockObject<T>* block_object = new ControlBlockObject<T>(std::forward<Args>(args)...);
+// `MakeShared` gives objects of at least this many bytes their own allocation, so that
+// their storage is freed with the last strong reference rather than the last weak one.
+// Off by default, keeping `MakeShared` to one allocation: specialize for a type to opt it
+// in, or set a threshold for every type at build time.
+#ifndef SMART_POINTERS_SEPARATE_STORAGE_BYTES
+#define SMART_POINTERS_SEPARATE_STORAGE_BYTES SIZE_MAX
+#endif
+template <typename T>
+struct SeparateStorageThreshold
+    : std::integral_constant<size_t, SMART_POINTERS_SEPARATE_STORAGE_BYTES> {};
+
+// Two allocations: the object is deleted as soon as the strong count reaches zero, and
+// only the small block stays behind for the remaining `WeakPtr`s
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeSharedSeparate(Args&&... args) {
+    T* object = new T(std::forward<Args>(args)...);
+    SharedPtr<T, Policy> result;
+    try {
+        result.block_ = NewBlock<ControlBlockPointer<T, Policy>>(object);
+    } catch (...) {
+        delete object;
+        throw;
+    }
+    result.observed_ = object;
+    LinkSharedFromThis(object, result.block_);
+    return result;
+}
+
+// One allocation for the block and the object, whatever the size of `T`
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeSharedInPlace(Args&&... args) {
+    SharedPtr<T, Policy> result;
+    auto* block_object = NewBlock<ControlBlockObject<T, Policy>>(std::forward<Args>(args)...);
     result.observed_ = reinterpret_cast<T*>(&block_object->buffer_);
     result.block_ = block_object;
-    if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-        result->weak_this.block_ = block_object;
-        result->weak_this.observed_ = result.observed_;
-        result->weak_this.block_->IncWeakCounter();
+    LinkSharedFromThis(result.observed_, block_object);
+    return result;
+}
+
+// Allocate memory only once, unless `T` opted in to `MakeSharedSeparate` by its size
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(Args&&... args) {
+    if constexpr (std::is_convertible_v<std::remove_cv_t<T>*, EmbeddedESFTBase*>) {
+        // The object carries its own block
+        return SharedPtr<T, Policy>(new T(std::forward<Args>(args)...));
+    } else if constexpr (sizeof(T) >= SeparateStorageThreshold<T>::value) {
+        return MakeSharedSeparate<T, Policy>(std::forward<Args>(args)...);
+    } else {
+        return MakeSharedInPlace<T, Policy>(std::forward<Args>(args)...);
     }
+}
+
+template <typename T, typename Policy, typename... Value>
+SharedPtr<T, Policy> MakeSharedArray(size_t size, const Value&... value) {
+    using Block = ControlBlockArray<std::remove_extent_t<T>, Policy>;
+    SharedPtr<T, Policy> result;
+    Block* block_object = Block::Create(size, value...);
+    result.observed_ = block_object->Elements();
+    result.block_ = block_object;
     return result;
 }
 
+// `MakeShared<T[]>(n)`: n value-initialized elements next to the block
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_unbounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(size_t size) {
+    return MakeSharedArray<T, Policy>(size);
+}
+
+// `MakeShared<T[]>(n, value)`: n copies of `value`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_unbounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(size_t size, const std::remove_extent_t<T>& value) {
+    return MakeSharedArray<T, Policy>(size, value);
+}
+
+// `MakeShared<T[N]>()`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_bounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared() {
+    return MakeSharedArray<T, Policy>(std::extent_v<T>);
+}
+
+// `MakeShared<T[N]>(value)`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_bounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(const std::remove_extent_t<T>& value) {
+    return MakeSharedArray<T, Policy>(std::extent_v<T>, value);
+}
+
+// Like `MakeShared`, but the block and the object are placed in memory obtained from
+// `alloc`; a copy of the allocator is kept in the block to free it later.
+template <typename T, typename Policy = SingleThreaded, typename Alloc, typename... Args,
+          typename = typename Alloc::value_type>
+SharedPtr<T, Policy> AllocateShared(const Alloc& alloc, Args&&... args) {
+    using Block = ControlBlockAllocated<T, Alloc, Policy>;
+    using Traits = std::allocator_traits<typename Block::BlockAllocator>;
+    typename Block::BlockAllocator allocator(alloc);
+    Block* block_object = Traits::allocate(allocator, 1);
+    try {
+        new (block_object) Block(allocator, std::forward<Args>(args)...);
+    } catch (...) {
+        Traits::deallocate(allocator, block_object, 1);
+        throw;
+    }
+    SharedPtr<T, Policy> result;
+    result.observed_ = reinterpret_cast<T*>(&block_object->buffer_);
+    result.block_ = block_object;
+    LinkSharedFromThis(result.observed_, block_object);
+    return result;
+}
+
+// Places the block in `resource`, e.g. a per-request `std::pmr::monotonic_buffer_resource`
+template <typename T, typename Policy = SingleThreaded, typename... Args>
+SharedPtr<T, Policy> AllocateShared(std::pmr::memory_resource* resource, Args&&... args) {
+    return AllocateShared<T, Policy>(std::pmr::polymorphic_allocator<T>(resource),
+                                     std::forward<Args>(args)...);
+}
+
 // Look for usage examples in tests
-template <typename T>
+// `weak_this` is an ordinary weak reference: it is released by the object's own
+// destructor while the strong owners still hold their +1 on the weak counter.
+template <typename T, typename Policy = SingleThreaded>
 class EnableSharedFromThis : public ESFTBase {
 public:
-    SharedPtr<T> SharedFromThis() {
+    SharedPtr<T, Policy> SharedFromThis() {
         return weak_this.Lock();
     }
-    SharedPtr<const T> SharedFromThis() const {
+    SharedPtr<const T, Policy> SharedFromThis() const {
         return weak_this.Lock();
     }
 
-    WeakPtr<T> WeakFromThis() noexcept {
+    WeakPtr<T, Policy> WeakFromThis() noexcept {
         return weak_this;
     }
-    WeakPtr<const T> WeakFromThis() const noexcept {
+    WeakPtr<const T, Policy> WeakFromThis() const noexcept {
         return weak_this;
     }
-    ~EnableSharedFromThis() {
-        if (weak_this.block_ != nullptr) {
-            --weak_this.block_->GetWeakCounter();
+    WeakPtr<T, Policy> weak_this;
+};
+
+// `EnableSharedFromThis` in a single pointer and without a weak count update at creation.
+// The object keeps a plain pointer to the block that owns it: the block always outlives the
+// object, since the strong owners' reference on the weak count is only dropped after the
+// object's destructor. `T` must derive from it non-virtually. Copies of an object are not
+// owned by its block, so the link is not copied.
+template <typename T, typename Policy = SingleThreaded>
+class CompactEnableSharedFromThis : public CompactESFTBase {
+public:
+    // Empty if the object is not owned by a `SharedPtr` or is being destroyed
+    SharedPtr<T, Policy> SharedFromThis() {
+        return Lock(static_cast<T*>(this));
+    }
+    SharedPtr<const T, Policy> SharedFromThis() const {
+        return Lock(static_cast<const T*>(this));
+    }
+
+    WeakPtr<T, Policy> WeakFromThis() noexcept {
+        return Observe(static_cast<T*>(this));
+    }
+    WeakPtr<const T, Policy> WeakFromThis() const noexcept {
+        return Observe(static_cast<const T*>(this));
+    }
+
+    BaseBlock<Policy>* this_block = nullptr;
+
+protected:
+    CompactEnableSharedFromThis() = default;
+    CompactEnableSharedFromThis(const CompactEnableSharedFromThis&) noexcept {};
+    CompactEnableSharedFromThis& operator=(const CompactEnableSharedFromThis&) noexcept {
+        return *this;
+    }
+
+private:
+    template <typename U>
+    SharedPtr<U, Policy> Lock(U* object) const {
+        SharedPtr<U, Policy> result;
+        if (this_block != nullptr && this_block->TryIncStrongCounter(true) == LockStatus::kLocked) {
+            result.block_ = this_block;
+            result.observed_ = object;
+        }
+        return result;
+    }
+    template <typename U>
+    WeakPtr<U, Policy> Observe(U* object) const noexcept {
+        WeakPtr<U, Policy> result;
+        if (this_block != nullptr) {
+            this_block->IncWeakCounter();
+            result.block_ = this_block;
+            result.observed_ = object;
+        }
+        return result;
+    }
+};
+
+// The block of an `EmbeddedEnableSharedFromThis` object. Its class `operator new` places it
+// right in front of the complete object, in the same allocation, so that it lives on after
+// the object's destructor and until the last weak reference. It has no manager until a
+// `SharedPtr` adopts the object.
+template <typename Policy>
+struct ControlBlockHeader : BaseBlock<Policy> {
+    ControlBlockHeader(void* memory, size_t alignment)
+        : BaseBlock<Policy>(nullptr), memory_(memory), alignment_(alignment){};
+
+    // Memory for a complete object of `size` bytes, with its block in front
+    static void* Allocate(size_t size, size_t alignment) {
+        alignment = std::max(alignment, alignof(ControlBlockHeader));
+        size_t header = (sizeof(ControlBlockHeader) + alignment - 1) / alignment * alignment;
+        void* memory = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                           ? ::operator new(header + size, std::align_val_t(alignment))
+                           : ::operator new(header + size);
+        void* object = static_cast<unsigned char*>(memory) + header;
+        try {
+            ::new (static_cast<void*>(Before(object))) ControlBlockHeader(memory, alignment);
+        } catch (...) {
+            Free(memory, alignment);
+            throw;
+        }
+        return object;
+    }
+    // Destroys the block and frees the whole allocation
+    void Deallocate() {
+        void* memory = memory_;
+        size_t alignment = alignment_;
+        this->~ControlBlockHeader();
+        Free(memory, alignment);
+    }
+
+    // The block of the complete object at `object`
+    static ControlBlockHeader* Before(void* object) {
+        return std::launder(reinterpret_cast<ControlBlockHeader*>(
+            static_cast<unsigned char*>(object) - sizeof(ControlBlockHeader)));
+    }
+
+    void* memory_;
+    size_t alignment_;
+    // The adopted object, as the type it was adopted as
+    void* object_ = nullptr;
+
+private:
+    static void Free(void* memory, size_t alignment) {
+        if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(memory, std::align_val_t(alignment));
+        } else {
+            ::operator delete(memory);
         }
-        weak_this.block_ = nullptr;
-        weak_this.observed_ = nullptr;
     }
-    WeakPtr<T> weak_this;
+};
+
+// `EnableSharedFromThis` whose control block comes with the object, so that adopting a raw
+// `new T` allocates nothing and `MakeShared` allocates only the object. The class
+// `operator new` reserves the block in front of the object; the memory of an owned object
+// is freed with the last weak reference. `T` must derive from it non-virtually, come from a
+// plain `new` (not `::new` nor placement new) and be owned through `SharedPtr(T*)`,
+// `Reset(T*)` or `MakeShared`; classes derived from it must not declare their own
+// `operator new`.
+template <typename T, typename Policy = SingleThreaded>
+class EmbeddedEnableSharedFromThis : public EmbeddedESFTBase {
+    using Block = ControlBlockHeader<Policy>;
+
+public:
+    // Empty if the object is not owned by a `SharedPtr` or is being destroyed
+    SharedPtr<T, Policy> SharedFromThis() {
+        return Lock(static_cast<T*>(this));
+    }
+    SharedPtr<const T, Policy> SharedFromThis() const {
+        return Lock(static_cast<const T*>(this));
+    }
+
+    WeakPtr<T, Policy> WeakFromThis() noexcept {
+        return Observe(static_cast<T*>(this));
+    }
+    WeakPtr<const T, Policy> WeakFromThis() const noexcept {
+        return Observe(static_cast<const T*>(this));
+    }
+
+    // Called by `SharedPtr` when it takes ownership of `object`
+    template <typename S>
+    BaseBlock<Policy>* AdoptEmbeddedBlock(S* object) {
+        const void* complete;
+        if constexpr (std::is_polymorphic_v<S>) {
+            complete = dynamic_cast<const void*>(object);
+        } else {
+            complete = object;
+        }
+        Block* block = Block::Before(const_cast<void*>(complete));
+        block->object_ = const_cast<std::remove_cv_t<S>*>(object);
+        block->manager_ = &Manage<S>;
+        this_block_ = block;
+        return block;
+    }
+
+    static void* operator new(size_t size) {
+        return Block::Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    }
+    static void* operator new(size_t size, std::align_val_t alignment) {
+        return Block::Allocate(size, static_cast<size_t>(alignment));
+    }
+    // For objects deleted before a `SharedPtr` adopted them, and failed constructors
+    static void operator delete(void* object) {
+        Block::Before(object)->Deallocate();
+    }
+    static void operator delete(void* object, std::align_val_t) {
+        Block::Before(object)->Deallocate();
+    }
+
+protected:
+    EmbeddedEnableSharedFromThis() = default;
+    EmbeddedEnableSharedFromThis(const EmbeddedEnableSharedFromThis&){};
+    EmbeddedEnableSharedFromThis& operator=(const EmbeddedEnableSharedFromThis&) noexcept {
+        return *this;
+    }
+    ~EmbeddedEnableSharedFromThis() = default;
+
+private:
+    template <typename S>
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* block = static_cast<Block*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<S>(PtrEvent::kDestroyed);
+            static_cast<S*>(block->object_)->~S();
+        } else if (op == BlockOp::kDeallocate) {
+            block->Deallocate();
+        } else if (op == BlockOp::kGetObject) {
+            return block->object_;
+        }
+        return nullptr;
+    }
+
+    template <typename U>
+    SharedPtr<U, Policy> Lock(U* object) const {
+        SharedPtr<U, Policy> result;
+        if (this_block_ != nullptr &&
+            this_block_->TryIncStrongCounter(true) == LockStatus::kLocked) {
+            result.block_ = this_block_;
+            result.observed_ = object;
+        }
+        return result;
+    }
+    template <typename U>
+    WeakPtr<U, Policy> Observe(U* object) const noexcept {
+        WeakPtr<U, Policy> result;
+        if (this_block_ != nullptr) {
+            this_block_->IncWeakCounter();
+            result.block_ = this_block_;
+            result.observed_ = object;
+        }
+        return result;
+    }
+
+    Block* this_block_ = nullptr;
 };
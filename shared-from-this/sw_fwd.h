@@ -1,12 +1,21 @@
 #pragma once
 
+#include <common/counter_policy.h>
+
 #include <exception>
 
 // Instead of std::bad_weak_ptr
 class BadWeakPtr : public std::exception {};
 
-template <typename T>
+template <typename T, typename Policy = SingleThreaded>
 class SharedPtr;
 
-template <typename T>
+template <typename T, typename Policy = SingleThreaded>
 class WeakPtr;
+
+// Shared ownership that stays on one thread: plain, non-atomic counters
+template <typename T>
+using LocalSharedPtr = SharedPtr<T, SingleThreaded>;
+
+template <typename T>
+using LocalWeakPtr = WeakPtr<T, SingleThreaded>;
@@ -0,0 +1,95 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Compact : CompactEnableSharedFromThis<Compact> {
+    int value = 1;
+};
+
+struct CompactDerived : Compact {
+    int extra = 2;
+};
+
+struct CompactConcurrent : CompactEnableSharedFromThis<CompactConcurrent, MultiThreaded> {};
+
+// Looks itself up while being destroyed
+struct CompactSelfCheck : CompactEnableSharedFromThis<CompactSelfCheck> {
+    ~CompactSelfCheck() {
+        *locked_in_destructor = static_cast<bool>(SharedFromThis());
+    }
+    bool* locked_in_destructor;
+};
+
+static_assert(sizeof(CompactEnableSharedFromThis<Compact>) == sizeof(void*));
+static_assert(sizeof(CompactEnableSharedFromThis<Compact>) <
+              sizeof(EnableSharedFromThis<Compact>));
+
+TEST_CASE("Compact SharedFromThis") {
+    SECTION("MakeShared") {
+        auto shared = MakeShared<Compact>();
+        // Linking the object did not take a weak reference
+        REQUIRE(shared.block_->GetWeakCounter() == 0);
+        REQUIRE(shared->SharedFromThis() == shared);
+        REQUIRE(shared.UseCount() == 1);
+
+        WeakPtr<Compact> weak = shared->WeakFromThis();
+        REQUIRE(weak.Lock() == shared);
+        shared.Reset();
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Adopted pointer") {
+        auto* raw = new Compact;
+        REQUIRE(!raw->SharedFromThis());
+        REQUIRE(raw->WeakFromThis().Expired());
+
+        SharedPtr<Compact> shared(raw);
+        REQUIRE(raw->SharedFromThis() == shared);
+        const Compact* const_raw = raw;
+        SharedPtr<const Compact> const_shared = const_raw->SharedFromThis();
+        REQUIRE(const_shared.Get() == raw);
+        REQUIRE(!const_raw->WeakFromThis().Expired());
+    }
+
+    SECTION("Derived types and other constructors") {
+        SharedPtr<Compact> base(new CompactDerived);
+        REQUIRE(base->SharedFromThis() == base);
+
+        bool deleted = false;
+        auto* raw = new Compact;
+        {
+            SharedPtr<Compact> with_deleter(raw, [&deleted](Compact* ptr) {
+                deleted = true;
+                delete ptr;
+            });
+            REQUIRE(raw->SharedFromThis() == with_deleter);
+        }
+        REQUIRE(deleted);
+
+        auto separate = MakeSharedSeparate<Compact>();
+        REQUIRE(separate->SharedFromThis() == separate);
+        auto allocated = AllocateShared<Compact>(std::allocator<Compact>());
+        REQUIRE(allocated->SharedFromThis() == allocated);
+        auto concurrent = MakeShared<CompactConcurrent, MultiThreaded>();
+        REQUIRE(concurrent->SharedFromThis() == concurrent);
+    }
+
+    SECTION("Copies are not linked") {
+        auto shared = MakeShared<Compact>();
+        Compact copy = *shared;
+        REQUIRE(!copy.SharedFromThis());
+        copy = *shared;
+        REQUIRE(copy.WeakFromThis().Expired());
+    }
+
+    SECTION("During destruction") {
+        bool locked = true;
+        auto shared = MakeShared<CompactSelfCheck>();
+        shared->locked_in_destructor = &locked;
+        shared.Reset();
+        REQUIRE(!locked);
+    }
+}
@@ -0,0 +1,125 @@
+#include "shared.h"
+#include "weak.h"
+
+#include "allocations_checker.h"
+
+#include <catch.hpp>
+
+#include <cstdint>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Embedded : EmbeddedEnableSharedFromThis<Embedded> {
+    explicit Embedded(int value = 0) : value(value) {
+        ++alive;
+    }
+    Embedded(const Embedded& other) : EmbeddedEnableSharedFromThis(other), value(other.value) {
+        ++alive;
+    }
+    Embedded& operator=(const Embedded&) = default;
+    virtual ~Embedded() {
+        --alive;
+    }
+
+    static inline int alive = 0;
+    int value;
+};
+
+struct EmbeddedOther {
+    virtual ~EmbeddedOther() = default;
+    int other = 0;
+};
+
+// `Embedded` is not at the start of the allocation
+struct EmbeddedSecondBase : EmbeddedOther, Embedded {};
+
+struct EmbeddedThrowing : EmbeddedEnableSharedFromThis<EmbeddedThrowing> {
+    EmbeddedThrowing() {
+        throw 1;
+    }
+};
+
+struct alignas(64) EmbeddedWide : EmbeddedEnableSharedFromThis<EmbeddedWide, MultiThreaded> {
+    int value = 3;
+};
+
+TEST_CASE("Embedded control block") {
+    SECTION("Adopting new T allocates nothing") {
+        auto* raw = new Embedded(1);
+        REQUIRE(!raw->SharedFromThis());
+        REQUIRE(raw->WeakFromThis().Expired());
+
+        SharedPtr<Embedded> shared;
+        EXPECT_ZERO_ALLOCATIONS(shared = SharedPtr<Embedded>(raw));
+        REQUIRE(raw->SharedFromThis() == shared);
+        REQUIRE(shared.UseCount() == 1);
+    }
+
+    SECTION("MakeShared allocates only the object") {
+        EXPECT_ONE_ALLOCATION({
+            auto shared = MakeShared<Embedded>(2);
+            REQUIRE(shared->value == 2);
+            REQUIRE(shared->SharedFromThis() == shared);
+        });
+    }
+
+    SECTION("Weak references outlive the object") {
+        auto shared = MakeShared<Embedded>(3);
+        WeakPtr<Embedded> weak = shared->WeakFromThis();
+        const Embedded* const_raw = shared.Get();
+        WeakPtr<const Embedded> const_weak = const_raw->WeakFromThis();
+        shared.Reset();
+        REQUIRE(Embedded::alive == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+        REQUIRE(const_weak.Expired());
+    }
+
+    SECTION("Other base first") {
+        SharedPtr<Embedded> shared(static_cast<Embedded*>(new EmbeddedSecondBase));
+        REQUIRE(shared->SharedFromThis() == shared);
+        shared.Reset();
+        REQUIRE(Embedded::alive == 0);
+    }
+
+    SECTION("Over-aligned") {
+        auto shared = MakeShared<EmbeddedWide, MultiThreaded>();
+        REQUIRE(reinterpret_cast<uintptr_t>(shared.Get()) % 64 == 0);
+        REQUIRE(shared->SharedFromThis()->value == 3);
+    }
+
+    SECTION("Reset adopts too") {
+        SharedPtr<Embedded> shared;
+        shared.Reset(new Embedded(4));
+        REQUIRE(shared->SharedFromThis() == shared);
+    }
+
+    SECTION("Deleted before it is owned") {
+        auto* raw = new Embedded(7);
+        REQUIRE(raw->WeakFromThis().Expired());
+        delete raw;
+        REQUIRE_THROWS_AS(new EmbeddedThrowing, int);
+    }
+
+    SECTION("Const objects") {
+        SharedPtr<const Embedded> shared(new const Embedded(8));
+        REQUIRE(shared->SharedFromThis() == shared);
+        WeakPtr<const Embedded> weak = shared->WeakFromThis();
+        shared.Reset();
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Objects that are not owned") {
+        Embedded local(5);
+        REQUIRE(!local.SharedFromThis());
+
+        auto shared = MakeShared<Embedded>(6);
+        Embedded copy = *shared;
+        REQUIRE(copy.value == 6);
+        REQUIRE(!copy.SharedFromThis());
+        copy = *shared;
+        REQUIRE(copy.WeakFromThis().Expired());
+    }
+
+    REQUIRE(Embedded::alive == 0);
+}
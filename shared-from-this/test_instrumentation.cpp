@@ -0,0 +1,63 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <string>
+
+// Built as its own target with SMART_POINTERS_INSTRUMENTATION defined. Mirrors the SharedPtr and
+// WeakPtr cases of weak/test_instrumentation.cpp, so that both copies of the headers are checked.
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct SharedNode {
+    int value = 0;
+};
+
+struct WeakNode {};
+
+PtrTypeStats StatsFor(const std::string& type) {
+    for (const PtrTypeStats& stats : PtrStats::Snapshot()) {
+        if (stats.type == type) {
+            return stats;
+        }
+    }
+    return PtrTypeStats{type};
+}
+
+TEST_CASE("Per-type counters") {
+    SECTION("SharedPtr and WeakPtr") {
+        PtrTypeStats before = StatsFor("SharedNode");
+        {
+            auto shared = MakeShared<SharedNode>();
+            SharedPtr<SharedNode> copy = shared;
+            SharedPtr<SharedNode> moved = std::move(copy);
+            WeakPtr<SharedNode> weak(shared);
+            REQUIRE(weak.Lock());
+            shared.Reset();
+            moved.Reset();
+            REQUIRE(!weak.Lock());
+            REQUIRE_THROWS_AS(SharedPtr<SharedNode>(weak), BadWeakPtr);
+        }
+        PtrTypeStats after = StatsFor("SharedNode");
+        auto delta = [&](PtrEvent event) { return after.Get(event) - before.Get(event); };
+        REQUIRE(delta(PtrEvent::kBlockAllocated) == 1);
+        REQUIRE(delta(PtrEvent::kDestroyed) == 1);
+        REQUIRE(delta(PtrEvent::kCopy) == 2);
+        REQUIRE(delta(PtrEvent::kMove) == 1);
+        REQUIRE(delta(PtrEvent::kLock) == 3);
+        REQUIRE(delta(PtrEvent::kLockFailed) == 2);
+    }
+
+    SECTION("Weak pointers made from shared ones") {
+        PtrTypeStats before = StatsFor("WeakNode");
+        {
+            auto shared = MakeShared<WeakNode>();
+            WeakPtr<WeakNode> weak(shared);
+            WeakPtr<WeakNode> assigned;
+            assigned = shared;
+        }
+        PtrTypeStats after = StatsFor("WeakNode");
+        REQUIRE(after.Get(PtrEvent::kCopy) - before.Get(PtrEvent::kCopy) == 2);
+    }
+}
@@ -58,6 +58,8 @@ public:
 
     CompressedPair(const F& first, const S& second) : S(second), first_(first){};
 
+    CompressedPair(const F& first, S&& second) : S(std::move(second)), first_(first){};
+
     CompressedPair(const F&& first) : first_(std::move(first)){};
 
     F& GetFirst() {
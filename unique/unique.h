@@ -2,6 +2,8 @@
 
 #include "compressed_pair.h"
 
+#include <common/instrumentation.h>
+
 #include <cstddef>  // std::nullptr_t
 
 template <typename T>
@@ -44,20 +46,26 @@ public:
     UniquePtr(T* ptr, Deleter&& deleter) noexcept : ptr_(ptr, std::move(deleter)){};
     template <typename F, typename AnotherDeleter = Deleter>
     UniquePtr(UniquePtr<F, AnotherDeleter>&& other) noexcept
-        : ptr_(other.Release(), std::move((other.GetDeleter()))){};
+        : ptr_(other.Release(), std::move((other.GetDeleter()))) {
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
     UniquePtr(UniquePtr&& other) noexcept
-        : ptr_(other.Release(), std::forward<Deleter>(other.GetDeleter())){};
+        : ptr_(other.Release(), std::forward<Deleter>(other.GetDeleter())) {
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
     template <typename F, typename AnotherDeleter = Deleter>
     UniquePtr& operator=(UniquePtr<F, AnotherDeleter>&& other) noexcept {
         Reset(other.Release());
         ptr_.GetSecond() = std::move(other.GetDeleter());
+        RecordPtrEvent<T>(PtrEvent::kMove);
         return *this;
     }
     UniquePtr& operator=(UniquePtr&& other) noexcept {
         Reset(other.Release());
         ptr_.GetSecond() = std::forward<Deleter>(other.GetDeleter());
+        RecordPtrEvent<T>(PtrEvent::kMove);
         return *this;
     }
     UniquePtr& operator=(std::nullptr_t) {
@@ -84,6 +92,7 @@ public:
         T* temporary = Get();
         ptr_.GetFirst() = ptr;
         if (temporary != nullptr) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
             GetDeleter()(temporary);
         }
     }
@@ -136,7 +145,9 @@ public:
     UniquePtr(T* ptr, Deleter&& deleter) noexcept : ptr_(ptr, std::move(deleter)){};
 
     UniquePtr(UniquePtr&& other) noexcept
-        : ptr_(other.Release(), std::forward<Deleter>(other.GetDeleter())){};
+        : ptr_(other.Release(), std::forward<Deleter>(other.GetDeleter())) {
+        RecordPtrEvent<T[]>(PtrEvent::kMove);
+    };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
@@ -144,6 +155,7 @@ public:
     UniquePtr& operator=(UniquePtr&& other) noexcept {
         Reset(other.Release());
         ptr_.GetSecond() = std::forward<Deleter>(other.GetDeleter());
+        RecordPtrEvent<T[]>(PtrEvent::kMove);
         return *this;
     }
     UniquePtr& operator=(std::nullptr_t) {
@@ -170,6 +182,7 @@ public:
         T* temporary = Get();
         ptr_.GetFirst() = ptr;
         if (temporary != nullptr) {
+            RecordPtrEvent<T[]>(PtrEvent::kDestroyed);
             GetDeleter()(temporary);
         }
     }
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>  // std::terminate
+#include <utility>
+
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#error "AtomicSharedPtr packs a reader count into the upper 16 bits of a pointer"
+#endif
+
+// Tagged heaps keep a tag in the top byte of every pointer, which the reader count overwrites
+#if defined(__SANITIZE_HWADDRESS__) || defined(__ARM_FEATURE_MEMORY_TAGGING)
+#error "AtomicSharedPtr needs untagged heap pointers"
+#elif defined(__has_feature)
+#if __has_feature(hwaddress_sanitizer)
+#error "AtomicSharedPtr needs untagged heap pointers"
+#endif
+#endif
+
+// Lock-free atomic cell for a `SharedPtr` or `WeakPtr`, built on split reference counts.
+//
+// The current value lives in an immutable heap node. The cell is a single 64-bit word
+// holding the node address in its low 48 bits and a count of readers in its high 16 bits.
+// A reader announces itself with one `fetch_add` on the word, which pins the node; it then
+// copies the value and takes its announcement back with a CAS, as long as the word still
+// points to the same node. A writer swaps in a new node and moves the reader count of the
+// old word into the old node's `internal` count; every reader that finds the node gone
+// decrements `internal` instead. Whoever brings `internal` to zero frees the node.
+// The 16-bit reader count allows up to 65535 threads inside `Load()` at once.
+template <typename Ptr>
+class AtomicPtrCell {
+public:
+    AtomicPtrCell() = default;
+    explicit AtomicPtrCell(Ptr value) : word_(Word(MakeNode(std::move(value)))){};
+    AtomicPtrCell(const AtomicPtrCell&) = delete;
+    AtomicPtrCell& operator=(const AtomicPtrCell&) = delete;
+    ~AtomicPtrCell() {
+        Retire(word_.load(std::memory_order_acquire), 0);
+    }
+
+    Ptr Load() const {
+        if (NodeOf(word_.load(std::memory_order_acquire)) == nullptr) {
+            return Ptr();
+        }
+        Node* node = Protect();
+        Ptr result = node != nullptr ? node->value : Ptr();
+        Unprotect(node);
+        return result;
+    }
+
+    void Store(Ptr desired) {
+        Retire(word_.exchange(Word(MakeNode(std::move(desired))), std::memory_order_acq_rel), 0);
+    }
+
+    Ptr Exchange(Ptr desired) {
+        uint64_t old =
+            word_.exchange(Word(MakeNode(std::move(desired))), std::memory_order_acq_rel);
+        // Readers may still be copying the old value, so it is copied rather than moved
+        Ptr result = NodeOf(old) != nullptr ? NodeOf(old)->value : Ptr();
+        Retire(old, 0);
+        return result;
+    }
+
+    bool CompareExchangeWeak(Ptr& expected, Ptr desired) {
+        return CompareExchange(expected, std::move(desired), false);
+    }
+
+    bool CompareExchangeStrong(Ptr& expected, Ptr desired) {
+        return CompareExchange(expected, std::move(desired), true);
+    }
+
+    static constexpr bool IsLockFree() {
+        return std::atomic<uint64_t>::is_always_lock_free;
+    }
+
+private:
+    struct Node {
+        explicit Node(Ptr value) : value(std::move(value)){};
+        const Ptr value;
+        std::atomic<int64_t> internal = 0;
+    };
+
+    static constexpr int kPointerBits = 48;
+    static constexpr uint64_t kPointerMask = (uint64_t(1) << kPointerBits) - 1;
+    static constexpr uint64_t kReader = uint64_t(1) << kPointerBits;
+
+    static Node* MakeNode(Ptr value) {
+        if (value.block_ == nullptr) {
+            return nullptr;
+        }
+        Node* node = new Node(std::move(value));
+        // 52-bit address spaces and top-byte tags would be cut off by `NodeOf`
+        if ((Word(node) & ~kPointerMask) != 0) {
+            std::terminate();
+        }
+        return node;
+    }
+    static uint64_t Word(Node* node) {
+        return reinterpret_cast<uintptr_t>(node);
+    }
+    static Node* NodeOf(uint64_t word) {
+        return reinterpret_cast<Node*>(word & kPointerMask);
+    }
+    static bool Holds(const Node* node, const Ptr& value) {
+        if (node == nullptr) {
+            return value.block_ == nullptr;
+        }
+        return node->value.block_ == value.block_ && node->value.observed_ == value.observed_;
+    }
+
+    // Pins the current node; it cannot be freed until `Unprotect`
+    Node* Protect() const {
+        return NodeOf(word_.fetch_add(kReader, std::memory_order_acquire));
+    }
+
+    void Unprotect(Node* node) const {
+        uint64_t word = word_.load(std::memory_order_relaxed);
+        while (NodeOf(word) == node) {
+            if (word_.compare_exchange_weak(word, word - kReader, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        // A writer has swapped the node out and handed our announcement to `internal`
+        Release(node, 1);
+    }
+
+    static void Release(Node* node, int64_t readers) {
+        if (node != nullptr &&
+            node->internal.fetch_sub(readers, std::memory_order_acq_rel) == readers) {
+            delete node;
+        }
+    }
+
+    // Called by the writer that removed `word` from the cell. `own` readers in it belong
+    // to the writer itself and are already accounted for.
+    static void Retire(uint64_t word, int64_t own) {
+        Node* node = NodeOf(word);
+        int64_t readers = static_cast<int64_t>(word >> kPointerBits) - own;
+        if (node != nullptr &&
+            node->internal.fetch_add(readers, std::memory_order_acq_rel) == -readers) {
+            delete node;
+        }
+    }
+
+    // The node for `desired` is made only once a comparison succeeds and is kept across
+    // retries, so a failing comparison costs no allocation
+    bool CompareExchange(Ptr& expected, Ptr desired, bool strong) {
+        Node* replacement = nullptr;
+        bool made = false;
+        uint64_t word = word_.fetch_add(kReader, std::memory_order_acquire) + kReader;
+        Node* node = NodeOf(word);
+        while (true) {
+            if (!Holds(node, expected)) {
+                expected = node != nullptr ? node->value : Ptr();
+                Unprotect(node);
+                delete replacement;
+                return false;
+            }
+            if (!made) {
+                replacement = MakeNode(std::move(desired));
+                made = true;
+            }
+            if (word_.compare_exchange_weak(word, Word(replacement), std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                Retire(word, 1);
+                return true;
+            }
+            if (NodeOf(word) == node) {
+                // Only the reader count changed
+                continue;
+            }
+            // Somebody else replaced the value: our announcement went to `internal`
+            Release(node, 1);
+            if (!strong) {
+                expected = Load();
+                delete replacement;
+                return false;
+            }
+            word = word_.fetch_add(kReader, std::memory_order_acquire) + kReader;
+            node = NodeOf(word);
+        }
+    }
+
+    mutable std::atomic<uint64_t> word_ = 0;
+};
+
+// https://en.cppreference.com/w/cpp/memory/shared_ptr/atomic2
+template <typename T, typename Policy = MultiThreaded>
+class AtomicSharedPtr {
+    static_assert(Policy::kThreadSafe, "AtomicSharedPtr needs thread-safe reference counts");
+
+public:
+    AtomicSharedPtr() = default;
+    AtomicSharedPtr(SharedPtr<T, Policy> value) : cell_(std::move(value)){};
+
+    SharedPtr<T, Policy> Load() const {
+        return cell_.Load();
+    }
+    void Store(SharedPtr<T, Policy> desired) {
+        cell_.Store(std::move(desired));
+    }
+    SharedPtr<T, Policy> Exchange(SharedPtr<T, Policy> desired) {
+        return cell_.Exchange(std::move(desired));
+    }
+    bool CompareExchangeWeak(SharedPtr<T, Policy>& expected, SharedPtr<T, Policy> desired) {
+        return cell_.CompareExchangeWeak(expected, std::move(desired));
+    }
+    bool CompareExchangeStrong(SharedPtr<T, Policy>& expected, SharedPtr<T, Policy> desired) {
+        return cell_.CompareExchangeStrong(expected, std::move(desired));
+    }
+    static constexpr bool IsLockFree() {
+        return AtomicPtrCell<SharedPtr<T, Policy>>::IsLockFree();
+    }
+
+private:
+    AtomicPtrCell<SharedPtr<T, Policy>> cell_;
+};
+
+// https://en.cppreference.com/w/cpp/memory/weak_ptr/atomic2
+template <typename T, typename Policy = MultiThreaded>
+class AtomicWeakPtr {
+    static_assert(Policy::kThreadSafe, "AtomicWeakPtr needs thread-safe reference counts");
+
+public:
+    AtomicWeakPtr() = default;
+    AtomicWeakPtr(WeakPtr<T, Policy> value) : cell_(std::move(value)){};
+
+    WeakPtr<T, Policy> Load() const {
+        return cell_.Load();
+    }
+    void Store(WeakPtr<T, Policy> desired) {
+        cell_.Store(std::move(desired));
+    }
+    WeakPtr<T, Policy> Exchange(WeakPtr<T, Policy> desired) {
+        return cell_.Exchange(std::move(desired));
+    }
+    bool CompareExchangeWeak(WeakPtr<T, Policy>& expected, WeakPtr<T, Policy> desired) {
+        return cell_.CompareExchangeWeak(expected, std::move(desired));
+    }
+    bool CompareExchangeStrong(WeakPtr<T, Policy>& expected, WeakPtr<T, Policy> desired) {
+        return cell_.CompareExchangeStrong(expected, std::move(desired));
+    }
+    static constexpr bool IsLockFree() {
+        return AtomicPtrCell<WeakPtr<T, Policy>>::IsLockFree();
+    }
+
+private:
+    AtomicPtrCell<WeakPtr<T, Policy>> cell_;
+};
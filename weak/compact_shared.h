@@ -0,0 +1,127 @@
+#pragma once
+
+#include "shared.h"
+
+#include <common/arena.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+// `SharedPtr` in 8 bytes: the block and the object are kept as 32-bit offsets into `Arena`.
+// Both must live in the arena, which is where `MakeCompactShared` puts them (through
+// `AllocateShared` with an `ArenaAllocator`).
+template <typename T, typename Arena, typename Policy = SingleThreaded>
+class CompactSharedPtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    CompactSharedPtr() = default;
+    CompactSharedPtr(std::nullptr_t){};
+    // Takes over the reference held by `ptr`. Throws `std::invalid_argument` and leaves `ptr`
+    // untouched if its block or object has no offset in the arena.
+    explicit CompactSharedPtr(SharedPtr<T, Policy>&& ptr) {
+        if (!Arena::Addressable(ptr.block_) || !Arena::Addressable(ptr.observed_)) {
+            throw std::invalid_argument("CompactSharedPtr: pointer outside the arena");
+        }
+        block_ = Arena::ToOffset(ptr.block_);
+        observed_ = Arena::ToOffset(ptr.observed_);
+        ptr.block_ = nullptr;
+        ptr.observed_ = nullptr;
+    };
+    CompactSharedPtr(const CompactSharedPtr& other)
+        : block_(other.block_), observed_(other.observed_) {
+        if (BaseBlock<Policy>* block = Block()) {
+            block->IncStrongCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+    CompactSharedPtr(CompactSharedPtr&& other) noexcept
+        : block_(other.block_), observed_(other.observed_) {
+        other.block_ = 0;
+        other.observed_ = 0;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    CompactSharedPtr& operator=(const CompactSharedPtr& other) {
+        CompactSharedPtr(other).Swap(*this);
+        return *this;
+    }
+    CompactSharedPtr& operator=(CompactSharedPtr&& other) noexcept {
+        CompactSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~CompactSharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (BaseBlock<Policy>* block = Block()) {
+            block_ = 0;
+            observed_ = 0;
+            block->DecStrongCounter();
+        }
+    }
+    void Swap(CompactSharedPtr& other) noexcept {
+        std::swap(block_, other.block_);
+        std::swap(observed_, other.observed_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return Arena::template FromOffset<T>(observed_);
+    }
+    T& operator*() const {
+        return *Get();
+    }
+    T* operator->() const {
+        return Get();
+    }
+    size_t UseCount() const {
+        if (block_ == 0) {
+            return 0;
+        }
+        return Block()->GetStrongCounter();
+    }
+    explicit operator bool() const {
+        return observed_ != 0;
+    }
+    // A full-width pointer sharing ownership, e.g. to make a `WeakPtr`
+    SharedPtr<T, Policy> ToShared() const {
+        SharedPtr<T, Policy> result;
+        if (BaseBlock<Policy>* block = Block()) {
+            block->IncStrongCounter();
+            result.block_ = block;
+            result.observed_ = Get();
+        }
+        return result;
+    }
+
+private:
+    BaseBlock<Policy>* Block() const {
+        return Arena::template FromOffset<BaseBlock<Policy>>(block_);
+    }
+
+    uint32_t block_ = 0;
+    uint32_t observed_ = 0;
+};
+
+template <typename T, typename Arena, typename Policy = SingleThreaded, typename... Args>
+CompactSharedPtr<T, Arena, Policy> MakeCompactShared(Args&&... args) {
+    return CompactSharedPtr<T, Arena, Policy>(
+        AllocateShared<T, Policy>(ArenaAllocator<T, Arena>(), std::forward<Args>(args)...));
+}
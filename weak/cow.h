@@ -0,0 +1,59 @@
+#pragma once
+
+#include "shared.h"
+
+#include <utility>  // std::as_const / std::in_place
+
+// A value of type `T` whose copies share storage until one of them is written: `Mutate()`
+// clones the value if other copies still refer to it, and writes in place otherwise.
+//
+// The storage is never exposed as a `SharedPtr` or `WeakPtr`, so a strong count of one
+// means the caller holds the only reference and nobody can make another. With atomic
+// counts the check is an acquire, ordered after every release of the other copies, so
+// their reads of the value happen before the write. `Policy` must provide `UniqueStrong`,
+// which `Biased` and `Sharded` do not.
+//
+// A moved-from `CowPtr` may only be assigned to or destroyed.
+template <typename T, typename Policy = SingleThreaded>
+class CowPtr {
+public:
+    CowPtr() : ptr_(MakeShared<T, Policy>()){};
+    explicit CowPtr(T value) : ptr_(MakeShared<T, Policy>(std::move(value))){};
+    template <typename... Args>
+    explicit CowPtr(std::in_place_t, Args&&... args)
+        : ptr_(MakeShared<T, Policy>(std::forward<Args>(args)...)){};
+
+    const T* Get() const {
+        return ptr_.Get();
+    }
+    const T& operator*() const {
+        return *ptr_;
+    }
+    const T* operator->() const {
+        return ptr_.Get();
+    }
+
+    // Write access, cloning first unless this is the only copy
+    T& Mutate() {
+        if (!Unique()) {
+            ptr_ = MakeShared<T, Policy>(std::as_const(*ptr_));
+        }
+        return *ptr_;
+    }
+
+    bool Unique() const {
+        return ptr_.block_->HasUniqueStrong();
+    }
+    size_t UseCount() const {
+        return ptr_.UseCount();
+    }
+
+private:
+    SharedPtr<T, Policy> ptr_;
+};
+
+// Constructs the value in place
+template <typename T, typename Policy = SingleThreaded, typename... Args>
+CowPtr<T, Policy> MakeCow(Args&&... args) {
+    return CowPtr<T, Policy>(std::in_place, std::forward<Args>(args)...);
+}
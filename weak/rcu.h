@@ -0,0 +1,145 @@
+#pragma once
+
+#include "shared.h"
+
+#include <common/epoch.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// A `SharedPtr` to read-mostly data (configuration, routing tables) that readers see as
+// consistent snapshots at almost no cost, and that writers replace as a whole.
+//
+// `ReadLock()` enters an `EpochDomain` read section and returns a guard for the current
+// version: no reference count is touched and nothing shared is written. `Publish` swaps
+// in a new version and keeps the old one's reference until every reader that could have
+// seen it has left; replaced versions are released by later `Publish` calls, by
+// `Synchronize`, or by the destructor, which waits for the remaining readers.
+template <typename T, typename Policy = MultiThreaded>
+class RcuPtr {
+    static_assert(Policy::kThreadSafe, "RcuPtr needs thread-safe reference counts");
+
+    struct Version {
+        explicit Version(SharedPtr<T, Policy> value) : value(std::move(value)){};
+        const SharedPtr<T, Policy> value;
+    };
+
+public:
+    // A read section: the version it points to stays alive until the guard is destroyed
+    class ReadGuard {
+    public:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard(ReadGuard&& other) noexcept
+            : version_(other.version_), object_(other.object_), entered_(other.entered_) {
+            other.entered_ = false;
+        }
+        ~ReadGuard() {
+            if (entered_) {
+                EpochDomain::Global().Leave();
+            }
+        }
+
+        const T* Get() const {
+            return object_;
+        }
+        const T& operator*() const {
+            return *object_;
+        }
+        const T* operator->() const {
+            return object_;
+        }
+        explicit operator bool() const {
+            return object_ != nullptr;
+        }
+        // Takes a reference, for a snapshot that has to outlive the read section
+        SharedPtr<T, Policy> Share() const {
+            return version_ != nullptr ? version_->value : SharedPtr<T, Policy>();
+        }
+
+    private:
+        friend class RcuPtr;
+
+        explicit ReadGuard(const Version* version)
+            : version_(version), object_(version != nullptr ? version->value.Get() : nullptr){};
+
+        const Version* version_;
+        const T* object_;
+        bool entered_ = true;
+    };
+
+    RcuPtr() = default;
+    explicit RcuPtr(SharedPtr<T, Policy> value) : current_(MakeVersion(std::move(value))){};
+    RcuPtr(const RcuPtr&) = delete;
+    RcuPtr& operator=(const RcuPtr&) = delete;
+    ~RcuPtr() {
+        Publish(SharedPtr<T, Policy>());
+        Synchronize();
+    }
+
+    // Wait-free, apart from registering the calling thread on its first read
+    ReadGuard ReadLock() const {
+        EpochDomain::Global().Enter();
+        return ReadGuard(current_.load(std::memory_order_acquire));
+    }
+
+    SharedPtr<T, Policy> Load() const {
+        return ReadLock().Share();
+    }
+
+    // Does not wait for readers: the replaced version is released once they are gone
+    void Publish(SharedPtr<T, Policy> value) {
+        Version* version = MakeVersion(std::move(value));
+        std::lock_guard lock(writer_);
+        Version* old = current_.exchange(version, std::memory_order_acq_rel);
+        if (old != nullptr) {
+            retired_.push_back({EpochDomain::Global().Advance(), old});
+        }
+        Collect();
+    }
+
+    // Waits for the readers of every replaced version and releases them all. Must not be
+    // called from inside a read section, which it would wait for; neither may the destructor.
+    void Synchronize() {
+        std::lock_guard lock(writer_);
+        EpochDomain::Global().WaitFor(EpochDomain::Global().Advance());
+        Collect();
+    }
+
+    // Replaced versions still waiting for readers
+    size_t Retired() const {
+        std::lock_guard lock(writer_);
+        return retired_.size();
+    }
+
+private:
+    struct RetiredVersion {
+        uint64_t epoch;
+        Version* version;
+    };
+
+    static Version* MakeVersion(SharedPtr<T, Policy> value) {
+        return value ? new Version(std::move(value)) : nullptr;
+    }
+
+    // Releases the versions that no reader can reach any more
+    void Collect() {
+        uint64_t oldest = EpochDomain::Global().OldestReader();
+        size_t kept = 0;
+        for (const RetiredVersion& retired : retired_) {
+            if (retired.epoch < oldest) {
+                delete retired.version;
+            } else {
+                retired_[kept++] = retired;
+            }
+        }
+        retired_.resize(kept);
+    }
+
+    std::atomic<Version*> current_ = nullptr;
+    mutable std::mutex writer_;
+    std::vector<RetiredVersion> retired_;
+};
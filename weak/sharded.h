@@ -0,0 +1,28 @@
+#pragma once
+
+#include "shared.h"
+
+#include <cstddef>
+#include <utility>
+
+// `SharedPtr` with `Sharded` counts: copies scale with the number of cores, and the object
+// is only released once its owner has called `Retire`.
+template <typename T, size_t kShards = 16>
+using ShardedSharedPtr = SharedPtr<T, Sharded<kShards>>;
+
+template <typename T, typename... Args>
+ShardedSharedPtr<T> MakeSharded(Args&&... args) {
+    return MakeShared<T, Sharded<>>(std::forward<Args>(args)...);
+}
+
+// Hands back the reference held by `owner`, normally the pointer the object was created
+// with, and switches the counts to a single counter: from then on the last release
+// destroys the object, possibly right here. Copies that still exist keep it alive.
+template <typename T, size_t kShards>
+void Retire(SharedPtr<T, Sharded<kShards>>& owner) {
+    BaseBlock<Sharded<kShards>>* block = std::exchange(owner.block_, nullptr);
+    owner.observed_ = nullptr;
+    if (block != nullptr && block->counts_.Retire()) {
+        block->ReleaseObject();
+    }
+}
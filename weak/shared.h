@@ -1,238 +1,346 @@
 #pragma once
 
 #include "sw_fwd.h"  // Forward declaration
+#include <common/block_pool.h>
+#include <common/instrumentation.h>
+#include <unique/compressed_pair.h>
+#include <algorithm>
+#include <memory>  // std::allocator_traits
+#include <memory_resource>
+#include <new>  // std::bad_array_new_length
+#include <type_traits>
 #include <utility>
 #include <cstddef>  // std::nullptr_t
+#include <cstdint>  // SIZE_MAX
 
-struct BaseBlock {
-    virtual void IncStrongCounter() = 0;
-    virtual void IncWeakCounter() = 0;
-    virtual void DecStrongCounter() = 0;
-    virtual void DecWeakCounter() = 0;
-    virtual ~BaseBlock(){};
-    virtual size_t GetStrongCounter() = 0;
-    [[maybe_unused]] virtual size_t GetWeakCounter() = 0;
-};
-template <typename T>
-struct ControlBlockPointer : BaseBlock {
-    ControlBlockPointer() = default;
-    ControlBlockPointer(T* object) : object_(object), strong_counter_(1){};
-    void DecStrongCounter() override {
-        if (this != nullptr) {
-            if (strong_counter_ != 0) {
-                --strong_counter_;
-            }
-            if (strong_counter_ == 0) {
-                if (object_ != nullptr) {
-                    delete object_;
-                }
-                if (weak_counter_ == 0) {
-                    delete this;
-                }
-            }
+// Operations dispatched through a block's manager: the last-release path, `kGetDeleter`,
+// which returns the stored deleter if its type tag matches, and `kGetObject`, which
+// returns the address of the owned object (the first element for arrays)
+enum class BlockOp { kDestroyObject, kDeallocate, kGetDeleter, kGetObject };
+
+// A unique address per type, compared instead of `typeid` when looking up a deleter
+template <typename D>
+const void* TypeTag() {
+    static constexpr char kTag = 0;
+    return &kTag;
+}
+
+// Counters live directly in the (non-polymorphic) header, so copies, releases
+// and `UseCount()` are inlined; the type-specific part is a single function
+// pointer that is only called once the strong or weak count reaches zero.
+// Blocks are aligned as the policy asks, see `BlockAlignment`.
+template <typename Policy>
+struct alignas(BlockAlignment<Policy>::value) BaseBlock {
+    using Manager = void* (*)(BaseBlock*, BlockOp, const void* type);
+
+    explicit BaseBlock(Manager manager) : manager_(manager) {
+        if constexpr (NeedsReleaseHook<Policy>::value) {
+            counts_.SetReleaseHook(&ReleaseFromHook, this);
         }
-    }
+    };
 
-    void DecWeakCounter() override {
-        if (this != nullptr) {
-            if (weak_counter_ != 0) {
-                --weak_counter_;
-            }
-            if (weak_counter_ == 0) {
-                if (strong_counter_ == 0) {
-                    delete this;
-                }
-            }
+    void IncStrongCounter() {
+        counts_.IncStrong();
+    }
+    void IncWeakCounter() {
+        counts_.IncWeak();
+    }
+    // Takes a strong reference unless the object is already gone
+    LockStatus TryIncStrongCounter(bool retry) {
+        return counts_.TryIncStrong(retry);
+    }
+    void DecStrongCounter() {
+        if (counts_.DecStrong()) {
+            ReleaseObject();
         }
     }
-
-    void IncStrongCounter() override {
-        ++strong_counter_;
+    // `count` strong references in one update, for bulk copies and releases
+    void AddStrongCounter(size_t count) {
+        counts_.AddStrong(count);
     }
-
-    void IncWeakCounter() override {
-        ++weak_counter_;
+    void SubStrongCounter(size_t count) {
+        if (counts_.SubStrong(count)) {
+            ReleaseObject();
+        }
     }
-
-    size_t GetStrongCounter() override {
-        return strong_counter_;
+    // Runs once the last strong reference is gone
+    void ReleaseObject() {
+        manager_(this, BlockOp::kDestroyObject, nullptr);
+        // Drop the weak reference held on behalf of the strong owners
+        DecWeakCounter();
+    }
+    // The release hook of policies that may finish a release on another thread
+    static void ReleaseFromHook(void* block) {
+        static_cast<BaseBlock*>(block)->ReleaseObject();
+    }
+    void DecWeakCounter() {
+        if (counts_.DecWeak()) {
+            manager_(this, BlockOp::kDeallocate, nullptr);
+        }
     }
-    size_t GetWeakCounter() override {
-        return weak_counter_;
+    size_t GetStrongCounter() const {
+        return counts_.Strong();
     }
-    ~ControlBlockPointer() {
-        object_ = nullptr;
-        strong_counter_ = 0;
-        weak_counter_ = 0;
+    // Whether the caller's reference is the only strong one, for copy-on-write
+    bool HasUniqueStrong() const {
+        return counts_.UniqueStrong();
     }
-    T* object_ = nullptr;
-    size_t strong_counter_ = 0;
-    size_t weak_counter_ = 0;
+    [[maybe_unused]] size_t GetWeakCounter() const {
+        return counts_.Weak() - (counts_.Strong() != 0);
+    }
+
+    Manager manager_;
+    typename Policy::RefCounts counts_;
 };
-template <typename T>
-struct ControlBlockObject : BaseBlock {
-    ControlBlockObject(T object) : strong_counter_(1) {
-        new (&buffer_) T(object);
+// The deleter is stored next to the pointer; an empty one takes no space.
+// `T` may be an array type, in which case the default deleter calls `delete[]`.
+template <typename T, typename Policy, typename Deleter = std::default_delete<T>>
+struct ControlBlockPointer : BaseBlock<Policy> {
+    using Element = std::remove_extent_t<T>;
+
+    ControlBlockPointer(Element* object) : BaseBlock<Policy>(&Manage), object_(object, Deleter()) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
     };
+    // Moves from `deleter` only once the memory for the block has been obtained
+    ControlBlockPointer(Element* object, Deleter& deleter)
+        : BaseBlock<Policy>(&Manage), object_(object, std::move(deleter)) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+    };
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void* type) {
+        auto* self = static_cast<ControlBlockPointer*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            self->object_.GetSecond()(self->object_.GetFirst());
+        } else if (op == BlockOp::kDeallocate) {
+            DeleteBlock(self);
+        } else if (op == BlockOp::kGetObject) {
+            return const_cast<std::remove_cv_t<Element>*>(self->object_.GetFirst());
+        } else if (type == TypeTag<Deleter>()) {
+            return &self->object_.GetSecond();
+        }
+        return nullptr;
+    }
+    CompressedPair<Element*, Deleter> object_;
+};
+template <typename T, typename Policy>
+struct ControlBlockObject : BaseBlock<Policy> {
     template <typename... Args>
-    ControlBlockObject(Args&&... args) : strong_counter_(1) {
-        new (&buffer_) T(std::forward<Args>(args)...);
+    ControlBlockObject(Args&&... args) : BaseBlock<Policy>(&Manage) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+        ::new (static_cast<void*>(&buffer_)) T(std::forward<Args>(args)...);
     };
-    void DecStrongCounter() override {
-        if (this != nullptr) {
-            if (this != nullptr) {
-                if (strong_counter_ != 0) {
-                    --strong_counter_;
-                }
-                if (strong_counter_ == 0) {
-                    if (&buffer_ != nullptr) {
-                        reinterpret_cast<T*>(&buffer_)->~T();
-                    }
-                    if (weak_counter_ == 0) {
-                        delete this;
-                    }
-                }
-            }
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockObject*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            reinterpret_cast<T*>(&self->buffer_)->~T();
+        } else if (op == BlockOp::kDeallocate) {
+            DeleteBlock(self);
+        } else if (op == BlockOp::kGetObject) {
+            return &self->buffer_;
         }
+        return nullptr;
     }
+    // Aligned as the block too, so that a line-aligned header does not share its last
+    // line with the object
+    alignas(std::max(alignof(T), BlockAlignment<Policy>::value)) unsigned char buffer_[sizeof(T)];
+};
 
-    void DecWeakCounter() override {
-        if (this != nullptr) {
-            if (weak_counter_ != 0) {
-                --weak_counter_;
-            }
-            if (weak_counter_ == 0) {
-                if (strong_counter_ == 0) {
-                    delete this;
-                }
+// `MakeShared<T[]>` block: the header, the length and the elements share one allocation,
+// with the elements starting at the first suitably aligned offset past the header
+template <typename T, typename Policy>
+struct ControlBlockArray : BaseBlock<Policy> {
+    explicit ControlBlockArray(size_t size) : BaseBlock<Policy>(&Manage), size_(size) {
+        RecordPtrEvent<T[]>(PtrEvent::kBlockAllocated);
+    };
+
+    template <typename... Value>
+    static ControlBlockArray* Create(size_t size, const Value&... value) {
+        // A wrapped size would allocate a short block and construct past its end
+        if (size > (SIZE_MAX - ElementsOffset()) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* memory = AllocateBlock(AllocationSize(size), Alignment());
+        auto* block = new (memory) ControlBlockArray(size);
+        size_t constructed = 0;
+        try {
+            for (; constructed < size; ++constructed) {
+                // `T(value...)` value-initializes when no value is given
+                ::new (static_cast<void*>(block->Elements() + constructed)) T(value...);
             }
+        } catch (...) {
+            block->DestroyElements(constructed);
+            block->~ControlBlockArray();
+            DeallocateBlock(memory, AllocationSize(size), Alignment());
+            throw;
         }
+        return block;
+    }
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockArray*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T[]>(PtrEvent::kDestroyed);
+            self->DestroyElements(self->size_);
+        } else if (op == BlockOp::kDeallocate) {
+            size_t bytes = AllocationSize(self->size_);
+            self->~ControlBlockArray();
+            DeallocateBlock(self, bytes, Alignment());
+        } else if (op == BlockOp::kGetObject) {
+            return const_cast<std::remove_cv_t<T>*>(self->Elements());
+        }
+        return nullptr;
     }
 
-    void IncStrongCounter() override {
-        ++strong_counter_;
+    static constexpr size_t Alignment() {
+        return std::max(alignof(ControlBlockArray), alignof(T));
     }
-    void IncWeakCounter() override {
-        ++weak_counter_;
+    static constexpr size_t ElementsOffset() {
+        return (sizeof(ControlBlockArray) + alignof(T) - 1) / alignof(T) * alignof(T);
     }
-
-    size_t GetStrongCounter() override {
-        return strong_counter_;
+    static size_t AllocationSize(size_t size) {
+        return ElementsOffset() + size * sizeof(T);
     }
-    size_t GetWeakCounter() override {
-        return weak_counter_;
+    T* Elements() {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + ElementsOffset());
     }
-    ~ControlBlockObject() {
-        strong_counter_ = 0;
-        weak_counter_ = 0;
+    // Reverse order of construction, as for built-in arrays
+    void DestroyElements(size_t count) {
+        for (size_t i = count; i > 0; --i) {
+            std::destroy_at(Elements() + i - 1);
+        }
     }
-    std::aligned_storage_t<sizeof(T), alignof(T)> buffer_;
-    size_t strong_counter_ = 0;
-    size_t weak_counter_ = 0;
+
+    size_t size_;
+};
+
+// `AllocateShared` block: the object and the rebound allocator that owns the memory
+template <typename T, typename Alloc, typename Policy>
+struct ControlBlockAllocated : BaseBlock<Policy> {
+    using BlockAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<ControlBlockAllocated>;
+    using ObjectAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+
+    template <typename... Args>
+    ControlBlockAllocated(const BlockAllocator& allocator, Args&&... args)
+        : BaseBlock<Policy>(&Manage), allocator_(allocator) {
+        RecordPtrEvent<T>(PtrEvent::kBlockAllocated);
+        ObjectAllocator object_allocator(allocator_);
+        std::allocator_traits<ObjectAllocator>::construct(
+            object_allocator, reinterpret_cast<std::remove_cv_t<T>*>(&buffer_),
+            std::forward<Args>(args)...);
+    };
+    static void* Manage(BaseBlock<Policy>* base, BlockOp op, const void*) {
+        auto* self = static_cast<ControlBlockAllocated*>(base);
+        if (op == BlockOp::kDestroyObject) {
+            RecordPtrEvent<T>(PtrEvent::kDestroyed);
+            ObjectAllocator object_allocator(self->allocator_);
+            std::allocator_traits<ObjectAllocator>::destroy(
+                object_allocator, reinterpret_cast<std::remove_cv_t<T>*>(&self->buffer_));
+        } else if (op == BlockOp::kDeallocate) {
+            BlockAllocator allocator(std::move(self->allocator_));
+            self->~ControlBlockAllocated();
+            std::allocator_traits<BlockAllocator>::deallocate(allocator, self, 1);
+        } else if (op == BlockOp::kGetObject) {
+            return &self->buffer_;
+        }
+        return nullptr;
+    }
+    [[no_unique_address]] BlockAllocator allocator_;
+    alignas(std::max(alignof(T), BlockAlignment<Policy>::value)) unsigned char buffer_[sizeof(T)];
 };
 
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
-template <typename T>
+template <typename T, typename Policy>
 class SharedPtr {
 public:
+    // `int` for both `SharedPtr<int>` and `SharedPtr<int[]>`
+    using ElementType = std::remove_extent_t<T>;
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
 
     SharedPtr() : block_(nullptr), observed_(nullptr){};
     SharedPtr(std::nullptr_t) : block_(nullptr), observed_(nullptr){};
-    explicit SharedPtr(T* ptr) : observed_(ptr) {
-        block_ = new ControlBlockPointer<T>(ptr);
+    explicit SharedPtr(ElementType* ptr) : observed_(ptr) {
+        block_ = NewBlock<ControlBlockPointer<T, Policy>>(ptr);
     };
     template <typename S>
-    SharedPtr(S* ptr) : observed_(ptr), block_(new ControlBlockPointer<S>(ptr)){};
-    SharedPtr(const SharedPtr& other) {
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
+    SharedPtr(S* ptr)
+        : block_(NewBlock<ControlBlockPointer<PointerBlockType<S>, Policy>>(ptr)), observed_(ptr){};
+    // One allocation: the deleter is stored inside the block
+    template <typename S, typename D>
+    SharedPtr(S* ptr, D deleter)
+        : block_(AdoptWithDeleter<DeleterBlockType<S, D>>(ptr, deleter)), observed_(ptr){};
+    SharedPtr(const SharedPtr& other) : block_(other.block_), observed_(other.observed_) {
         if (block_ != nullptr) {
-            block_->DecStrongCounter();
-        }
-        if (other.observed_ != observed_) {
-            observed_ = other.observed_;
-            block_ = other.block_;
             block_->IncStrongCounter();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
-    SharedPtr(SharedPtr&& other) {
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
+    // Moves hand the reference over without touching the counters
+    SharedPtr(SharedPtr&& other) noexcept : block_(other.block_), observed_(other.observed_) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
+
+    template <typename S>
+    SharedPtr(const SharedPtr<S, Policy>& other)
+        : block_(other.block_), observed_(other.observed_) {
         if (block_ != nullptr) {
-            block_->DecStrongCounter();
-        }
-        if (other.block_ != nullptr) {
-            block_ = other.block_;
-            observed_ = other.observed_;
             block_->IncStrongCounter();
-            other.Reset();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     };
-
     template <typename S>
-    SharedPtr(SharedPtr<S> ptr) : observed_(ptr.observed_), block_(ptr.block_) {
-        block_->IncStrongCounter();
+    SharedPtr(SharedPtr<S, Policy>&& other) noexcept
+        : block_(other.block_), observed_(other.observed_) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
     };
 
     // Aliasing constructor
     // #8 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) : observed_(ptr), block_(other.block_) {
-        block_->IncStrongCounter();
+    SharedPtr(const SharedPtr<Y, Policy>& other, ElementType* ptr)
+        : block_(other.block_), observed_(ptr) {
+        if (block_ != nullptr) {
+            block_->IncStrongCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    };
+    template <typename Y>
+    SharedPtr(SharedPtr<Y, Policy>&& other, ElementType* ptr)
+        : block_(other.block_), observed_(ptr) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
     };
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
-    explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Policy>& other) {
+        RecordPtrEvent<T>(PtrEvent::kLock);
+        if (other.block_ == nullptr ||
+            other.block_->TryIncStrongCounter(true) != LockStatus::kLocked) {
+            RecordPtrEvent<T>(PtrEvent::kLockFailed);
             throw BadWeakPtr{};
         }
         block_ = other.block_;
         observed_ = other.observed_;
-        if (block_ != nullptr) {
-            block_->IncStrongCounter();
-        }
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
 
     SharedPtr& operator=(const SharedPtr& other) {
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-            return *this;
-        }
-        if (block_ != nullptr) {
-            block_->DecStrongCounter();
-        }
-        if (other.observed_ != observed_) {
-            observed_ = other.observed_;
-            block_ = other.block_;
-            block_->IncStrongCounter();
-        }
+        SharedPtr(other).Swap(*this);
         return *this;
     }
-    SharedPtr& operator=(SharedPtr&& other) {
-        if (other.block_ == nullptr) {
-            block_ = nullptr;
-            observed_ = nullptr;
-        }
-        if (block_ != nullptr) {
-            block_->DecStrongCounter();
-        }
-        if (other.block_ != nullptr) {
-            block_ = other.block_;
-            observed_ = other.observed_;
-            block_->IncStrongCounter();
-            other.Reset();
-        }
+    SharedPtr& operator=(SharedPtr&& other) noexcept {
+        SharedPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -264,17 +372,26 @@ public:
         if (block_ != nullptr) {
             block_->DecStrongCounter();
         }
-        block_ = new ControlBlockPointer<S>(ptr);
+        block_ = NewBlock<ControlBlockPointer<PointerBlockType<S>, Policy>>(ptr);
+        observed_ = ptr;
+    }
+    void Reset(ElementType* ptr) {
+        if (block_ != nullptr) {
+            block_->DecStrongCounter();
+        }
+        block_ = NewBlock<ControlBlockPointer<T, Policy>>(ptr);
         observed_ = ptr;
     }
-    void Reset(T* ptr) {
+    template <typename S, typename D>
+    void Reset(S* ptr, D deleter) {
+        BaseBlock<Policy>* block = AdoptWithDeleter<DeleterBlockType<S, D>>(ptr, deleter);
         if (block_ != nullptr) {
             block_->DecStrongCounter();
         }
-        block_ = new ControlBlockPointer<T>(ptr);
+        block_ = block;
         observed_ = ptr;
     }
-    void Swap(SharedPtr& other) {
+    void Swap(SharedPtr& other) noexcept {
         std::swap(block_, other.block_);
         std::swap(observed_, other.observed_);
     }
@@ -282,18 +399,22 @@ public:
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Observers
 
-    T* Get() const {
+    ElementType* Get() const {
         if (block_ == nullptr) {
             return nullptr;
         }
         return observed_;
     }
-    T& operator*() const {
+    ElementType& operator*() const {
         return *observed_;
     }
-    T* operator->() const {
+    ElementType* operator->() const {
         return observed_;
     }
+    ElementType& operator[](std::ptrdiff_t index) const {
+        static_assert(std::is_array_v<T>, "operator[] needs SharedPtr<T[]> or SharedPtr<T[N]>");
+        return observed_[index];
+    }
     size_t UseCount() const {
         if (block_ == nullptr) {
             return 0;
@@ -303,23 +424,158 @@ public:
     explicit operator bool() const {
         return Get() != nullptr;
     }
-    BaseBlock* block_ = nullptr;
-    T* observed_ = nullptr;
+    // The deleter given to the constructor or `Reset`, or nullptr if it is not a `D`
+    template <typename D>
+    D* GetDeleter() const {
+        if (block_ == nullptr) {
+            return nullptr;
+        }
+        return static_cast<D*>(block_->manager_(block_, BlockOp::kGetDeleter, TypeTag<D>()));
+    }
+    BaseBlock<Policy>* block_ = nullptr;
+    ElementType* observed_ = nullptr;
+
+private:
+    // A raw pointer handed to `SharedPtr<T[]>` is released with `delete[]`
+    template <typename S>
+    using PointerBlockType = std::conditional_t<std::is_array_v<T>, T, S>;
+    template <typename S, typename D>
+    using DeleterBlockType = ControlBlockPointer<PointerBlockType<S>, Policy, D>;
+
+    // Like `std::shared_ptr`, the object is released with `deleter` if the block
+    // cannot be allocated
+    template <typename Block, typename D>
+    static BaseBlock<Policy>* AdoptWithDeleter(typename Block::Element* ptr, D& deleter) {
+        try {
+            return NewBlock<Block>(ptr, deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+    }
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right);
+template <typename T, typename U, typename Policy>
+inline bool operator==(const SharedPtr<T, Policy>& left, const SharedPtr<U, Policy>& right) {
+    return left.block_ == right.block_ && left.observed_ == right.observed_;
+}
 
-// Allocate memory only once
-template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    SharedPtr<T> result;
-    ControlBlockObject<T>* block_object = new ControlBlockObject<T>(std::forward<Args>(args)...);
+// `MakeShared` gives objects of at least this many bytes their own allocation, so that
+// their storage is freed with the last strong reference rather than the last weak one.
+// Off by default, keeping `MakeShared` to one allocation: specialize for a type to opt it
+// in, or set a threshold for every type at build time.
+#ifndef SMART_POINTERS_SEPARATE_STORAGE_BYTES
+#define SMART_POINTERS_SEPARATE_STORAGE_BYTES SIZE_MAX
+#endif
+template <typename T>
+struct SeparateStorageThreshold
+    : std::integral_constant<size_t, SMART_POINTERS_SEPARATE_STORAGE_BYTES> {};
+
+// Two allocations: the object is deleted as soon as the strong count reaches zero, and
+// only the small block stays behind for the remaining `WeakPtr`s
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeSharedSeparate(Args&&... args) {
+    T* object = new T(std::forward<Args>(args)...);
+    SharedPtr<T, Policy> result;
+    try {
+        result.block_ = NewBlock<ControlBlockPointer<T, Policy>>(object);
+    } catch (...) {
+        delete object;
+        throw;
+    }
+    result.observed_ = object;
+    return result;
+}
+
+// One allocation for the block and the object, whatever the size of `T`
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeSharedInPlace(Args&&... args) {
+    SharedPtr<T, Policy> result;
+    auto* block_object = NewBlock<ControlBlockObject<T, Policy>>(std::forward<Args>(args)...);
     result.observed_ = reinterpret_cast<T*>(&block_object->buffer_);
     result.block_ = block_object;
     return result;
 }
 
+// Allocate memory only once, unless `T` opted in to `MakeSharedSeparate` by its size
+template <typename T, typename Policy = SingleThreaded, typename... Args,
+          typename = std::enable_if_t<!std::is_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(Args&&... args) {
+    if constexpr (sizeof(T) >= SeparateStorageThreshold<T>::value) {
+        return MakeSharedSeparate<T, Policy>(std::forward<Args>(args)...);
+    } else {
+        return MakeSharedInPlace<T, Policy>(std::forward<Args>(args)...);
+    }
+}
+
+template <typename T, typename Policy, typename... Value>
+SharedPtr<T, Policy> MakeSharedArray(size_t size, const Value&... value) {
+    using Block = ControlBlockArray<std::remove_extent_t<T>, Policy>;
+    SharedPtr<T, Policy> result;
+    Block* block_object = Block::Create(size, value...);
+    result.observed_ = block_object->Elements();
+    result.block_ = block_object;
+    return result;
+}
+
+// `MakeShared<T[]>(n)`: n value-initialized elements next to the block
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_unbounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(size_t size) {
+    return MakeSharedArray<T, Policy>(size);
+}
+
+// `MakeShared<T[]>(n, value)`: n copies of `value`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_unbounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(size_t size, const std::remove_extent_t<T>& value) {
+    return MakeSharedArray<T, Policy>(size, value);
+}
+
+// `MakeShared<T[N]>()`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_bounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared() {
+    return MakeSharedArray<T, Policy>(std::extent_v<T>);
+}
+
+// `MakeShared<T[N]>(value)`
+template <typename T, typename Policy = SingleThreaded,
+          typename = std::enable_if_t<std::is_bounded_array_v<T>>>
+SharedPtr<T, Policy> MakeShared(const std::remove_extent_t<T>& value) {
+    return MakeSharedArray<T, Policy>(std::extent_v<T>, value);
+}
+
+// Like `MakeShared`, but the block and the object are placed in memory obtained from
+// `alloc`; a copy of the allocator is kept in the block to free it later.
+template <typename T, typename Policy = SingleThreaded, typename Alloc, typename... Args,
+          typename = typename Alloc::value_type>
+SharedPtr<T, Policy> AllocateShared(const Alloc& alloc, Args&&... args) {
+    using Block = ControlBlockAllocated<T, Alloc, Policy>;
+    using Traits = std::allocator_traits<typename Block::BlockAllocator>;
+    typename Block::BlockAllocator allocator(alloc);
+    Block* block_object = Traits::allocate(allocator, 1);
+    try {
+        new (block_object) Block(allocator, std::forward<Args>(args)...);
+    } catch (...) {
+        Traits::deallocate(allocator, block_object, 1);
+        throw;
+    }
+    SharedPtr<T, Policy> result;
+    result.observed_ = reinterpret_cast<T*>(&block_object->buffer_);
+    result.block_ = block_object;
+    return result;
+}
+
+// Places the block in `resource`, e.g. a per-request `std::pmr::monotonic_buffer_resource`
+template <typename T, typename Policy = SingleThreaded, typename... Args>
+SharedPtr<T, Policy> AllocateShared(std::pmr::memory_resource* resource, Args&&... args) {
+    return AllocateShared<T, Policy>(std::pmr::polymorphic_allocator<T>(resource),
+                                     std::forward<Args>(args)...);
+}
+
 // Look for usage examples in tests
 template <typename T>
 class EnableSharedFromThis {
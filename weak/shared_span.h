@@ -0,0 +1,111 @@
+#pragma once
+
+#include "shared.h"
+
+#include <cstddef>
+
+// Bulk copies and releases of `SharedPtr`s that touch each control block once per call
+// instead of once per element. When thousands of elements point to a few blocks (fan-out),
+// thousands of contended RMWs on atomic counters become a handful.
+
+// Net changes to the strong counts of up to `kSlots` distinct blocks. A block that does not
+// fit makes the pending changes apply first, so any number of blocks can be handled.
+template <typename Policy>
+class BlockDeltas {
+public:
+    BlockDeltas() = default;
+    BlockDeltas(const BlockDeltas&) = delete;
+    BlockDeltas& operator=(const BlockDeltas&) = delete;
+    ~BlockDeltas() {
+        Apply();
+    }
+
+    void Add(BaseBlock<Policy>* block, std::ptrdiff_t delta) {
+        if (block == nullptr) {
+            return;
+        }
+        // Runs of the same block are the common case
+        if (size_ != 0 && slots_[last_].block == block) {
+            slots_[last_].delta += delta;
+            return;
+        }
+        for (size_t i = 0; i < size_; ++i) {
+            if (slots_[i].block == block) {
+                slots_[i].delta += delta;
+                last_ = i;
+                return;
+            }
+        }
+        if (size_ == kSlots) {
+            Apply();
+        }
+        last_ = size_;
+        slots_[size_++] = {block, delta};
+    }
+
+    // Increments go first, so that no block reaches zero while it is still being referenced
+    void Apply() {
+        for (size_t i = 0; i < size_; ++i) {
+            if (slots_[i].delta > 0) {
+                slots_[i].block->AddStrongCounter(slots_[i].delta);
+            }
+        }
+        for (size_t i = 0; i < size_; ++i) {
+            if (slots_[i].delta < 0) {
+                slots_[i].block->SubStrongCounter(-slots_[i].delta);
+            }
+        }
+        size_ = 0;
+    }
+
+private:
+    static constexpr size_t kSlots = 16;
+
+    struct Slot {
+        BaseBlock<Policy>* block;
+        std::ptrdiff_t delta;
+    };
+
+    Slot slots_[kSlots];
+    size_t size_ = 0;
+    size_t last_ = 0;
+};
+
+// Copies `count` pointers from `from` into `to`, which must hold empty pointers
+// (e.g. a freshly resized vector)
+template <typename T, typename Policy>
+void CopySpan(const SharedPtr<T, Policy>* from, size_t count, SharedPtr<T, Policy>* to) {
+    BlockDeltas<Policy> deltas;
+    for (size_t i = 0; i < count; ++i) {
+        deltas.Add(from[i].block_, 1);
+        to[i].block_ = from[i].block_;
+        to[i].observed_ = from[i].observed_;
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+}
+
+// Resets `count` pointers starting at `ptrs`
+template <typename T, typename Policy>
+void DestroySpan(SharedPtr<T, Policy>* ptrs, size_t count) {
+    BlockDeltas<Policy> deltas;
+    for (size_t i = 0; i < count; ++i) {
+        deltas.Add(ptrs[i].block_, -1);
+        ptrs[i].block_ = nullptr;
+        ptrs[i].observed_ = nullptr;
+    }
+}
+
+// `to[i] = from[i]` for `count` elements; only the difference between the old and the new
+// references is applied to each block. The ranges may be the same, but must not overlap
+// otherwise.
+template <typename T, typename Policy>
+void AssignSpan(const SharedPtr<T, Policy>* from, size_t count, SharedPtr<T, Policy>* to) {
+    BlockDeltas<Policy> deltas;
+    for (size_t i = 0; i < count; ++i) {
+        deltas.Add(from[i].block_, 1);
+        deltas.Add(to[i].block_, -1);
+        to[i].block_ = from[i].block_;
+        to[i].observed_ = from[i].observed_;
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+}
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <common/counter_policy.h>
+
 #include <exception>
 
 class BadWeakPtr : public std::exception {};
 
-template <typename T>
+template <typename T, typename Policy = SingleThreaded>
 class SharedPtr;
 
-template <typename T>
+template <typename T, typename Policy = SingleThreaded>
 class WeakPtr;
+
+// Shared ownership that stays on one thread: plain, non-atomic counters
+template <typename T>
+using LocalSharedPtr = SharedPtr<T, SingleThreaded>;
+
+template <typename T>
+using LocalWeakPtr = WeakPtr<T, SingleThreaded>;
@@ -0,0 +1,81 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <memory_resource>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct AllocatorStats {
+    int allocations = 0;
+    int deallocations = 0;
+};
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator(AllocatorStats* stats) : stats(stats) {
+    }
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : stats(other.stats) {
+    }
+
+    T* allocate(size_t n) {
+        ++stats->allocations;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        ++stats->deallocations;
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>& other) const {
+        return stats == other.stats;
+    }
+
+    AllocatorStats* stats;
+};
+
+TEST_CASE("AllocateShared with a user allocator") {
+    AllocatorStats stats;
+    const int alive_before = MyInt::AliveCount();
+
+    WeakPtr<MyInt> weak;
+    {
+        auto shared = AllocateShared<MyInt>(CountingAllocator<MyInt>(&stats), 42);
+        REQUIRE(*shared == 42);
+        REQUIRE(shared.UseCount() == 1);
+        REQUIRE(stats.allocations == 1);
+        weak = WeakPtr<MyInt>(shared);
+    }
+    REQUIRE(MyInt::AliveCount() == alive_before);
+    REQUIRE(stats.deallocations == 0);
+
+    weak.Reset();
+    REQUIRE(stats.deallocations == 1);
+}
+
+TEST_CASE("AllocateShared from a memory resource") {
+    alignas(std::max_align_t) char buffer[1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                              std::pmr::null_memory_resource());
+
+    SECTION("No global allocations") {
+        EXPECT_ZERO_ALLOCATIONS(REQUIRE(*AllocateShared<int>(&arena, 1) == 1));
+        EXPECT_ZERO_ALLOCATIONS(REQUIRE(*AllocateShared<int, MultiThreaded>(&arena, 2) == 2));
+    }
+
+    SECTION("Allocator is propagated to the object") {
+        auto str = AllocateShared<std::pmr::string>(&arena, 100, 'x');
+        REQUIRE(str->size() == 100);
+        REQUIRE(str->get_allocator().resource() == &arena);
+    }
+}
@@ -0,0 +1,133 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <cstdint>
+#include <new>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Tracked {
+    static inline std::vector<int> destroyed;
+    static inline int constructed = 0;
+    static inline int throw_at = -1;
+
+    Tracked() : id(constructed++) {
+        if (id == throw_at) {
+            throw 42;
+        }
+    }
+    ~Tracked() {
+        destroyed.push_back(id);
+    }
+
+    int id;
+};
+
+struct alignas(64) Wide {
+    char bytes[64];
+};
+
+TEST_CASE("MakeShared for arrays") {
+    SECTION("Value-initialized, one allocation") {
+#ifndef SMART_POINTERS_POOLED_BLOCKS
+        // Pooled blocks come from slabs carved in advance
+        EXPECT_ONE_ALLOCATION(auto sp = MakeShared<int[]>(5));
+#endif
+        auto sp = MakeShared<int[]>(5);
+        for (int i = 0; i < 5; ++i) {
+            REQUIRE(sp[i] == 0);
+            sp[i] = i * i;
+        }
+        REQUIRE(sp[4] == 16);
+        REQUIRE(sp.Get() == &sp[0]);
+        REQUIRE(sp.UseCount() == 1);
+    }
+
+    SECTION("Filled with a value") {
+        auto sp = MakeShared<double[]>(4, 2.5);
+        for (int i = 0; i < 4; ++i) {
+            REQUIRE(sp[i] == 2.5);
+        }
+        EXPECT_ONE_ALLOCATION(MakeShared<double[]>(1000, 1.0));
+    }
+
+    SECTION("Bounded") {
+        const int alive_before = MyInt::AliveCount();
+        {
+            auto sp = MakeShared<MyInt[3], MultiThreaded>(7);
+            REQUIRE(MyInt::AliveCount() == alive_before + 3);
+            REQUIRE(sp[2] == 7);
+            auto copy = sp;
+            REQUIRE(copy.UseCount() == 2);
+        }
+        REQUIRE(MyInt::AliveCount() == alive_before);
+        REQUIRE(MakeShared<int[8]>()[7] == 0);
+    }
+
+    SECTION("Empty") {
+        auto sp = MakeShared<MyInt[]>(0);
+        REQUIRE(sp.UseCount() == 1);
+    }
+
+    SECTION("Elements destroyed in reverse order") {
+        Tracked::constructed = 0;
+        Tracked::destroyed.clear();
+        MakeShared<Tracked[]>(3).Reset();
+        REQUIRE(Tracked::destroyed == std::vector<int>{2, 1, 0});
+    }
+
+    SECTION("Faulty element constructor") {
+        Tracked::constructed = 0;
+        Tracked::throw_at = 2;
+        Tracked::destroyed.clear();
+        REQUIRE_THROWS(MakeShared<Tracked[]>(4));
+        Tracked::throw_at = -1;
+        REQUIRE(Tracked::destroyed == std::vector<int>{1, 0});
+    }
+
+    SECTION("Length too large for the block") {
+        const int alive_before = MyInt::AliveCount();
+        REQUIRE_THROWS_AS(MakeShared<MyInt[]>(SIZE_MAX / sizeof(MyInt)), std::bad_array_new_length);
+        REQUIRE_THROWS_AS(MakeShared<Wide[]>(SIZE_MAX / 64 + 1), std::bad_array_new_length);
+        REQUIRE(MyInt::AliveCount() == alive_before);
+    }
+
+    SECTION("Over-aligned elements") {
+        auto sp = MakeShared<Wide[]>(3);
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(reinterpret_cast<uintptr_t>(&sp[i]) % 64 == 0);
+        }
+    }
+}
+
+TEST_CASE("SharedPtr owning a new[] array") {
+    Tracked::constructed = 0;
+    Tracked::destroyed.clear();
+    SharedPtr<Tracked[]> sp(new Tracked[3]);
+    REQUIRE(sp[1].id == 1);
+
+    sp.Reset(new Tracked[2]);
+    REQUIRE(Tracked::destroyed.size() == 3);
+    sp.Reset();
+    REQUIRE(Tracked::destroyed.size() == 5);
+}
+
+TEST_CASE("WeakPtr and aliasing for arrays") {
+    auto sp = MakeShared<int[]>(3, 1);
+    WeakPtr<int[]> weak(sp);
+    REQUIRE(weak.Lock()[2] == 1);
+
+    SharedPtr<int> element(sp, &sp[1]);
+    sp.Reset();
+    REQUIRE(!weak.Expired());
+    REQUIRE(*element == 1);
+    element.Reset();
+    REQUIRE(weak.Expired());
+}
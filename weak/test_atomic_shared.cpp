@@ -0,0 +1,122 @@
+#include "atomic_shared.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Wrapping policies are thread-safe only if their base is
+static_assert(MultiThreaded::kThreadSafe && Packed::kThreadSafe && Biased::kThreadSafe);
+static_assert(!SingleThreaded::kThreadSafe);
+static_assert(CacheIsolated<MultiThreaded>::kThreadSafe);
+static_assert(!CacheIsolated<SingleThreaded>::kThreadSafe);
+
+struct Counted {
+    Counted(int value) : value(value) {
+        alive.fetch_add(1);
+    }
+    Counted(const Counted& other) : value(other.value) {
+        alive.fetch_add(1);
+    }
+    ~Counted() {
+        alive.fetch_sub(1);
+    }
+
+    int value;
+    inline static std::atomic<int> alive = 0;
+};
+
+template <typename T>
+using ConcurrentSharedPtr = SharedPtr<T, MultiThreaded>;
+
+TEST_CASE("AtomicSharedPtr basics") {
+    REQUIRE(AtomicSharedPtr<int>::IsLockFree());
+    {
+        AtomicSharedPtr<Counted> atomic;
+        REQUIRE(atomic.Load().Get() == nullptr);
+
+        auto first = MakeShared<Counted, MultiThreaded>(1);
+        atomic.Store(first);
+        REQUIRE(atomic.Load() == first);
+        REQUIRE(first.UseCount() == 2);
+
+        auto second = MakeShared<Counted, MultiThreaded>(2);
+        auto previous = atomic.Exchange(second);
+        REQUIRE(previous == first);
+        REQUIRE(first.UseCount() == 2);
+
+        ConcurrentSharedPtr<Counted> expected = first;
+        REQUIRE(!atomic.CompareExchangeStrong(expected, first));
+        REQUIRE(expected == second);
+
+        // A failed comparison does not build a node for `desired`
+        expected = first;
+        EXPECT_ZERO_ALLOCATIONS(REQUIRE(!atomic.CompareExchangeStrong(expected, first)));
+        expected = first;
+        EXPECT_ZERO_ALLOCATIONS(REQUIRE(!atomic.CompareExchangeWeak(expected, first)));
+        REQUIRE(expected == second);
+        REQUIRE(atomic.CompareExchangeStrong(expected, ConcurrentSharedPtr<Counted>()));
+        REQUIRE(atomic.Load().Get() == nullptr);
+        REQUIRE(second.UseCount() == 2);
+    }
+    REQUIRE(Counted::alive.load() == 0);
+}
+
+TEST_CASE("AtomicWeakPtr basics") {
+    auto shared = MakeShared<Counted, MultiThreaded>(1);
+    AtomicWeakPtr<Counted> atomic(WeakPtr<Counted, MultiThreaded>{shared});
+    REQUIRE(atomic.Load().Lock() == shared);
+    shared.Reset();
+    REQUIRE(atomic.Load().Expired());
+    atomic.Store(WeakPtr<Counted, MultiThreaded>());
+    REQUIRE(Counted::alive.load() == 0);
+}
+
+TEST_CASE("Concurrent readers and writers") {
+    {
+        AtomicSharedPtr<Counted> atomic(MakeShared<Counted, MultiThreaded>(0));
+        std::atomic<bool> stop = false;
+        std::atomic<int> bad_reads = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                while (!stop.load()) {
+                    auto value = atomic.Load();
+                    if (value.Get() == nullptr || value->value < 0) {
+                        bad_reads.fetch_add(1);
+                    }
+                }
+            });
+        }
+
+        std::vector<std::thread> writers;
+        for (int i = 0; i < 2; ++i) {
+            writers.emplace_back([&atomic] {
+                for (int j = 1; j <= 20000; ++j) {
+                    auto current = atomic.Load();
+                    auto next = MakeShared<Counted, MultiThreaded>(current->value + 1);
+                    while (!atomic.CompareExchangeWeak(current, next)) {
+                        next = MakeShared<Counted, MultiThreaded>(current->value + 1);
+                    }
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        REQUIRE(bad_reads.load() == 0);
+        REQUIRE(atomic.Load()->value == 40000);
+    }
+    REQUIRE(Counted::alive.load() == 0);
+}
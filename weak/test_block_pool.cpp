@@ -0,0 +1,50 @@
+#include <common/block_pool.h>
+
+#include <catch.hpp>
+
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Block pool reuses freed blocks") {
+    BlockPool::FlushThreadCache();
+    auto before = BlockPool::Stats();
+
+    void* first = BlockPool::Allocate(24);
+    BlockPool::Deallocate(first, 24);
+    void* second = BlockPool::Allocate(20);
+    REQUIRE(second == first);
+    BlockPool::Deallocate(second, 20);
+
+    auto after = BlockPool::Stats();
+    REQUIRE(after.hits - before.hits == 1);
+    REQUIRE(after.misses - before.misses == 1);
+    REQUIRE(after.bytes_cached >= 32);
+}
+
+TEST_CASE("Block pool spills to the depot in batches") {
+    BlockPool::FlushThreadCache();
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 4 * BlockPool::kBatchSize; ++i) {
+        blocks.push_back(BlockPool::Allocate(64));
+    }
+    for (void* block : blocks) {
+        BlockPool::Deallocate(block, 64);
+    }
+
+    // Blocks freed on this thread can be picked up by another one
+    auto before = BlockPool::Stats();
+    std::thread([] {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < BlockPool::kBatchSize; ++i) {
+            blocks.push_back(BlockPool::Allocate(64));
+        }
+        for (void* block : blocks) {
+            BlockPool::Deallocate(block, 64);
+        }
+    }).join();
+    auto after = BlockPool::Stats();
+    REQUIRE(after.misses - before.misses == 1);
+    REQUIRE(after.bytes_cached == before.bytes_cached);
+}
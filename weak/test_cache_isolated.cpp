@@ -0,0 +1,105 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct alignas(64) LineAligned {
+    int value = 0;
+};
+
+struct alignas(256) PageStriped {
+    char bytes[300] = {};
+};
+
+struct HotFields {
+    long long reads = 0;
+    long long writes = 0;
+};
+
+template <typename T>
+bool AlignedTo(const T* ptr, size_t alignment) {
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+size_t Line(const void* ptr, size_t line_size) {
+    return reinterpret_cast<uintptr_t>(ptr) / line_size;
+}
+
+TEST_CASE("Over-aligned objects") {
+    SECTION("MakeShared") {
+        for (int i = 0; i < 16; ++i) {
+            auto ptr = MakeShared<LineAligned>();
+            REQUIRE(AlignedTo(ptr.Get(), 64));
+        }
+        auto wide = MakeShared<PageStriped>();
+        REQUIRE(AlignedTo(wide.Get(), 256));
+    }
+
+    SECTION("Separate storage") {
+        auto ptr = MakeSharedSeparate<PageStriped>();
+        REQUIRE(AlignedTo(ptr.Get(), 256));
+    }
+
+    SECTION("AllocateShared") {
+        auto ptr = AllocateShared<LineAligned>(std::allocator<LineAligned>());
+        REQUIRE(AlignedTo(ptr.Get(), 64));
+    }
+
+    SECTION("Arrays") {
+        auto ptr = MakeShared<LineAligned[]>(5);
+        for (int i = 0; i < 5; ++i) {
+            REQUIRE(AlignedTo(&ptr[i], 64));
+        }
+    }
+}
+
+TEST_CASE("CacheIsolated counts") {
+    using Isolated = CacheIsolated<>;
+    static_assert(alignof(BaseBlock<Isolated>) == 64);
+    // The manager and the counts share one line
+    static_assert(sizeof(BaseBlock<Isolated>) == 64);
+    static_assert(sizeof(BaseBlock<CacheIsolated<MultiThreaded, 128>>) == 128);
+
+    SECTION("The object starts on a line of its own") {
+        for (int i = 0; i < 16; ++i) {
+            auto ptr = MakeShared<HotFields, Isolated>();
+            const auto& counts = ptr.block_->counts_;
+            REQUIRE(AlignedTo(ptr.Get(), 64));
+            REQUIRE(Line(&counts, 64) != Line(ptr.Get(), 64));
+            REQUIRE(Line(reinterpret_cast<const char*>(&counts) + sizeof(counts) - 1, 64) <
+                    Line(ptr.Get(), 64));
+            REQUIRE(reinterpret_cast<const char*>(ptr.Get()) -
+                        reinterpret_cast<const char*>(ptr.block_) ==
+                    64);
+        }
+    }
+
+    SECTION("Wider lines") {
+        using Wide = CacheIsolated<MultiThreaded, 128>;
+        auto ptr = MakeShared<HotFields, Wide>();
+        REQUIRE(AlignedTo(ptr.Get(), 128));
+        REQUIRE(Line(&ptr.block_->counts_, 128) != Line(ptr.Get(), 128));
+    }
+
+    SECTION("Counts behave as their base") {
+        auto ptr = MakeShared<HotFields, Isolated>();
+        WeakPtr<HotFields, Isolated> weak = ptr;
+        auto copy = ptr;
+        REQUIRE(ptr.UseCount() == 2);
+        copy.Reset();
+        ptr.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+    }
+
+    SECTION("Over-aligned objects") {
+        auto ptr = MakeShared<PageStriped, Isolated>();
+        REQUIRE(AlignedTo(ptr.Get(), 256));
+    }
+}
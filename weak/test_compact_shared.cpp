@@ -0,0 +1,113 @@
+#include "compact_shared.h"
+#include "shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct CompactSharedTag {};
+using SharedArena = Arena<CompactSharedTag, size_t(1) << 24>;
+
+template <typename T, typename Policy = SingleThreaded>
+using CompactPtr = CompactSharedPtr<T, SharedArena, Policy>;
+
+TEST_CASE("CompactSharedPtr is two offsets") {
+    REQUIRE(sizeof(CompactPtr<MyInt>) == 8);
+    REQUIRE(sizeof(CompactPtr<std::string, MultiThreaded>) == 8);
+
+    CompactPtr<MyInt> empty;
+    REQUIRE(!empty);
+    REQUIRE(empty.Get() == nullptr);
+    REQUIRE(empty.UseCount() == 0);
+    REQUIRE(!empty.ToShared());
+}
+
+TEST_CASE("CompactSharedPtr lives in the arena") {
+    {
+        CompactPtr<MyInt> a;
+        EXPECT_ZERO_ALLOCATIONS((a = MakeCompactShared<MyInt, SharedArena>(42)));
+        REQUIRE(SharedArena::Contains(a.Get()));
+        REQUIRE(*a == 42);
+        REQUIRE(a.UseCount() == 1);
+        REQUIRE(MyInt::AliveCount() == 1);
+    }
+    REQUIRE(MyInt::AliveCount() == 0);
+}
+
+TEST_CASE("CompactSharedPtr copy/move") {
+    auto a = MakeCompactShared<std::string, SharedArena>("abacaba");
+    CompactPtr<std::string> b = a;
+    CompactPtr<std::string> c = std::move(a);
+    REQUIRE(!a);
+    REQUIRE(c.UseCount() == 2);
+    REQUIRE(*b == "abacaba");
+    REQUIRE(c->size() == 7);
+
+    auto d = MakeCompactShared<std::string, SharedArena>("karabas");
+    b = d;
+    REQUIRE(c.UseCount() == 1);
+    REQUIRE(d.UseCount() == 2);
+
+    b.Swap(c);
+    REQUIRE(*b == "abacaba");
+    REQUIRE(*c == "karabas");
+
+    c.Reset();
+    REQUIRE(!c);
+    REQUIRE(d.UseCount() == 1);
+}
+
+TEST_CASE("CompactSharedPtr converts to SharedPtr") {
+    WeakPtr<MyInt> weak;
+    {
+        auto compact = MakeCompactShared<MyInt, SharedArena>(7);
+        SharedPtr<MyInt> shared = compact.ToShared();
+        REQUIRE(shared.Get() == compact.Get());
+        REQUIRE(compact.UseCount() == 2);
+        weak = shared;
+
+        CompactPtr<MyInt> back(std::move(shared));
+        REQUIRE(!shared);
+        REQUIRE(back.UseCount() == 2);
+        REQUIRE(!weak.Expired());
+    }
+    REQUIRE(weak.Expired());
+    REQUIRE(MyInt::AliveCount() == 0);
+}
+
+TEST_CASE("CompactSharedPtr rejects pointers outside the arena") {
+    SharedPtr<MyInt> heap = MakeShared<MyInt>(1);
+    REQUIRE_THROWS_AS(CompactPtr<MyInt>(std::move(heap)), std::invalid_argument);
+    REQUIRE(heap.UseCount() == 1);
+
+    struct Pair {
+        int32_t first;
+        int32_t second;
+    };
+    SharedPtr<Pair> pair = AllocateShared<Pair>(ArenaAllocator<Pair, SharedArena>(), 1, 2);
+    SharedPtr<int32_t> unaligned(pair, &pair->second);
+    REQUIRE_THROWS_AS(CompactPtr<int32_t>(std::move(unaligned)), std::invalid_argument);
+    REQUIRE(unaligned.Get() == &pair->second);
+    REQUIRE(pair.UseCount() == 2);
+
+    SharedPtr<int32_t> aligned(pair, &pair->first);
+    CompactPtr<int32_t> compact(std::move(aligned));
+    REQUIRE(*compact == 1);
+}
+
+TEST_CASE("CompactSharedPtr with atomic counts") {
+    auto a = MakeCompactShared<MyInt, SharedArena, MultiThreaded>(1);
+    auto b = a;
+    REQUIRE(a.UseCount() == 2);
+    a.Reset();
+    REQUIRE(b.UseCount() == 1);
+}
@@ -0,0 +1,92 @@
+#include "cow.h"
+#include "shared.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Attributes {
+    Attributes() = default;
+    Attributes(const Attributes& other) : values(other.values) {
+        ++copies;
+    }
+
+    static inline int copies = 0;
+    std::array<int, 32> values = {};
+};
+
+TEST_CASE("CowPtr copies share storage") {
+    Attributes::copies = 0;
+    CowPtr<Attributes> original;
+    CowPtr<Attributes> copy;
+    EXPECT_ZERO_ALLOCATIONS(copy = original);
+    REQUIRE(copy.Get() == original.Get());
+    REQUIRE(original.UseCount() == 2);
+    REQUIRE(!original.Unique());
+    REQUIRE(Attributes::copies == 0);
+}
+
+TEST_CASE("CowPtr clones on the first write to a shared value") {
+    Attributes::copies = 0;
+    auto original = MakeCow<Attributes>();
+    auto copy = original;
+
+    EXPECT_ONE_ALLOCATION(copy.Mutate().values[0] = 1);
+    REQUIRE(Attributes::copies == 1);
+    REQUIRE(copy->values[0] == 1);
+    REQUIRE(original->values[0] == 0);
+    REQUIRE(original.Unique());
+    REQUIRE(copy.Unique());
+
+    // Both are unique now: further writes stay in place
+    const Attributes* storage = copy.Get();
+    EXPECT_ZERO_ALLOCATIONS(copy.Mutate().values[1] = 2);
+    REQUIRE(copy.Get() == storage);
+    REQUIRE(Attributes::copies == 1);
+}
+
+TEST_CASE("CowPtr constructors") {
+    Attributes attributes;
+    attributes.values[3] = 3;
+    CowPtr<Attributes> from_value(attributes);
+    REQUIRE(from_value->values[3] == 3);
+
+    auto in_place = MakeCow<std::vector<int>>(4, 7);
+    REQUIRE(in_place->size() == 4);
+    in_place.Mutate().push_back(8);
+    REQUIRE((*in_place)[4] == 8);
+
+    CowPtr<std::vector<int>> moved = std::move(in_place);
+    REQUIRE(moved.Unique());
+    REQUIRE(moved->size() == 5);
+}
+
+TEST_CASE("CowPtr with copies released on other threads") {
+    for (int round = 0; round < 100; ++round) {
+        auto value = MakeCow<Attributes, MultiThreaded>();
+        value.Mutate().values[0] = round;
+        std::atomic<int> seen = 0;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([copy = value, &seen]() mutable {
+                seen += copy->values[0];
+                copy = CowPtr<Attributes, MultiThreaded>();
+            });
+        }
+        // Writes in place only once every reader has let go, and clones otherwise
+        value.Mutate().values[0] = -1;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(seen == 4 * round);
+        REQUIRE(value.Unique());
+        REQUIRE(value->values[0] == -1);
+    }
+}
@@ -0,0 +1,113 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+#include <unique/deleters.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Returns objects to a free list instead of deleting them
+struct Pool {
+    std::vector<MyInt*> free;
+};
+
+struct PoolDeleter {
+    void operator()(MyInt* object) const {
+        pool->free.push_back(object);
+    }
+    Pool* pool;
+};
+
+int released_handles = 0;
+
+void ReleaseHandle(int* handle) {
+    ++released_handles;
+    delete handle;
+}
+
+TEST_CASE("Custom deleters") {
+    SECTION("Stateful deleter, one allocation") {
+        MyInt object(1);
+        Pool pool;
+        pool.free.reserve(1);
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+        // The block comes from a slab the pool carved in advance
+        SharedPtr<MyInt>(&object, PoolDeleter{&pool});
+#else
+        EXPECT_ONE_ALLOCATION(SharedPtr<MyInt>(&object, PoolDeleter{&pool}));
+#endif
+        REQUIRE(pool.free.size() == 1);
+        REQUIRE(pool.free[0] == &object);
+    }
+
+    SECTION("GetDeleter") {
+        MyInt object(2);
+        Pool pool;
+        SharedPtr<MyInt> sp(&object, PoolDeleter{&pool});
+        REQUIRE(sp.GetDeleter<PoolDeleter>() != nullptr);
+        REQUIRE(sp.GetDeleter<PoolDeleter>()->pool == &pool);
+        REQUIRE(sp.GetDeleter<int>() == nullptr);
+        REQUIRE(SharedPtr<MyInt>().GetDeleter<PoolDeleter>() == nullptr);
+        REQUIRE(MakeShared<MyInt>(3).GetDeleter<PoolDeleter>() == nullptr);
+    }
+
+    SECTION("Function pointer") {
+        released_handles = 0;
+        {
+            SharedPtr<int> sp(new int(4), &ReleaseHandle);
+            auto copy = sp;
+            WeakPtr<int> weak(sp);
+            sp.Reset();
+            REQUIRE(released_handles == 0);
+            copy.Reset();
+            REQUIRE(released_handles == 1);
+            REQUIRE(weak.Expired());
+        }
+        REQUIRE(released_handles == 1);
+    }
+
+    SECTION("Empty deleters take no space") {
+        auto lambda = [](int* p) { delete p; };
+        using WithLambda = ControlBlockPointer<int, SingleThreaded, decltype(lambda)>;
+        REQUIRE(sizeof(WithLambda) == sizeof(ControlBlockPointer<int, SingleThreaded>));
+        SharedPtr<int> sp(new int(5), lambda);
+        REQUIRE(*sp == 5);
+    }
+
+    SECTION("Move-only deleter") {
+        SharedPtr<int> sp(new int(6), Deleter<int>(42));
+        REQUIRE(sp.GetDeleter<Deleter<int>>()->GetTag() == 42);
+        sp.Reset();
+    }
+
+    SECTION("Reset with a deleter") {
+        released_handles = 0;
+        MyInt object(7);
+        Pool pool;
+        SharedPtr<int> sp(new int(8), &ReleaseHandle);
+        SharedPtr<MyInt> other;
+        other.Reset(&object, PoolDeleter{&pool});
+        sp.Reset(new int(9), &ReleaseHandle);
+        REQUIRE(released_handles == 1);
+        REQUIRE(*sp == 9);
+        other.Reset();
+        REQUIRE(pool.free.size() == 1);
+    }
+
+    SECTION("Arrays") {
+        bool called = false;
+        SharedPtr<int[]> sp(new int[3]{1, 2, 3}, [&called](int* p) {
+            called = true;
+            delete[] p;
+        });
+        REQUIRE(sp[2] == 3);
+        sp.Reset();
+        REQUIRE(called);
+    }
+}
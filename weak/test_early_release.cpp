@@ -0,0 +1,87 @@
+#include "shared.h"
+#include "weak.h"
+
+#include "allocations_checker.h"
+#include <catch.hpp>
+
+#include <cstddef>
+#include <new>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Counts the bytes of its instances that are still allocated, dead or alive
+template <size_t kSize>
+struct Payload {
+    static inline size_t live_bytes = 0;
+    static inline int alive = 0;
+
+    static void* operator new(size_t size) {
+        live_bytes += size;
+        return ::operator new(size);
+    }
+    static void operator delete(void* memory, size_t size) {
+        live_bytes -= size;
+        ::operator delete(memory);
+    }
+
+    explicit Payload(int value) : value(value) {
+        ++alive;
+    }
+    ~Payload() {
+        --alive;
+    }
+
+    int value;
+    char bytes[kSize] = {};
+};
+
+using LargePayload = Payload<4096>;
+using SmallPayload = Payload<16>;
+// Large, but not opted in: kept next to its block
+using PinnedPayload = Payload<8192>;
+
+template <>
+struct SeparateStorageThreshold<LargePayload> : std::integral_constant<size_t, 1024> {};
+template <>
+struct SeparateStorageThreshold<SmallPayload> : std::integral_constant<size_t, 1024> {};
+
+TEST_CASE("Early release of large objects") {
+    SECTION("Storage goes with the last strong reference") {
+        auto shared = MakeShared<LargePayload>(7);
+        WeakPtr<LargePayload> weak(shared);
+        REQUIRE(shared->value == 7);
+        REQUIRE(LargePayload::live_bytes == sizeof(LargePayload));
+
+        shared.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(LargePayload::alive == 0);
+        REQUIRE(LargePayload::live_bytes == 0);
+    }
+
+    SECTION("Small objects share the block's allocation") {
+        EXPECT_ONE_ALLOCATION({
+            auto shared = MakeShared<SmallPayload>(1);
+            REQUIRE(shared->value == 1);
+        });
+        REQUIRE(SmallPayload::live_bytes == 0);
+    }
+
+    SECTION("Large objects stay in place unless their type opts in") {
+        EXPECT_ONE_ALLOCATION({
+            auto shared = MakeShared<PinnedPayload>(2);
+            REQUIRE(PinnedPayload::live_bytes == 0);
+            REQUIRE(shared->value == 2);
+        });
+    }
+
+    SECTION("Explicit separate storage") {
+        auto shared = MakeSharedSeparate<SmallPayload, MultiThreaded>(3);
+        WeakPtr<SmallPayload, MultiThreaded> weak(shared);
+        REQUIRE(SmallPayload::live_bytes == sizeof(SmallPayload));
+        REQUIRE(weak.Lock()->value == 3);
+
+        shared.Reset();
+        REQUIRE(SmallPayload::alive == 0);
+        REQUIRE(SmallPayload::live_bytes == 0);
+    }
+}
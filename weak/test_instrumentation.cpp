@@ -0,0 +1,128 @@
+#include "shared.h"
+#include "thin_shared.h"
+#include "weak.h"
+
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+
+#include <catch.hpp>
+
+#include <string>
+#include <thread>
+
+// Built as its own target with SMART_POINTERS_INSTRUMENTATION defined
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct SharedNode {
+    int value = 0;
+};
+
+struct ThinNode {};
+
+struct IntrusiveNode : SimpleRefCounted<IntrusiveNode> {};
+
+struct UniqueNode {};
+
+PtrTypeStats StatsFor(const std::string& type) {
+    for (const PtrTypeStats& stats : PtrStats::Snapshot()) {
+        if (stats.type == type) {
+            return stats;
+        }
+    }
+    return PtrTypeStats{type};
+}
+
+TEST_CASE("Per-type counters") {
+    SECTION("SharedPtr and WeakPtr") {
+        PtrTypeStats before = StatsFor("SharedNode");
+        {
+            auto shared = MakeShared<SharedNode>();
+            SharedPtr<SharedNode> copy = shared;
+            SharedPtr<SharedNode> moved = std::move(copy);
+            WeakPtr<SharedNode> weak(shared);
+            REQUIRE(weak.Lock());
+            shared.Reset();
+            moved.Reset();
+            REQUIRE(!weak.Lock());
+            REQUIRE_THROWS_AS(SharedPtr<SharedNode>(weak), BadWeakPtr);
+        }
+        PtrTypeStats after = StatsFor("SharedNode");
+        auto delta = [&](PtrEvent event) { return after.Get(event) - before.Get(event); };
+        REQUIRE(delta(PtrEvent::kBlockAllocated) == 1);
+        REQUIRE(delta(PtrEvent::kDestroyed) == 1);
+        REQUIRE(delta(PtrEvent::kCopy) == 2);
+        REQUIRE(delta(PtrEvent::kMove) == 1);
+        REQUIRE(delta(PtrEvent::kLock) == 3);
+        REQUIRE(delta(PtrEvent::kLockFailed) == 2);
+    }
+
+    SECTION("Weak pointers made from shared ones") {
+        PtrTypeStats before = StatsFor("ThinNode");
+        {
+            auto shared = MakeShared<ThinNode>();
+            WeakPtr<ThinNode> weak(shared);
+            ThinSharedPtr<ThinNode> thin(shared);
+            ThinWeakPtr<ThinNode> thin_weak(thin);
+        }
+        PtrTypeStats after = StatsFor("ThinNode");
+        REQUIRE(after.Get(PtrEvent::kCopy) - before.Get(PtrEvent::kCopy) == 3);
+    }
+
+    SECTION("IntrusivePtr and UniquePtr") {
+        PtrTypeStats intrusive_before = StatsFor("IntrusiveNode");
+        PtrTypeStats unique_before = StatsFor("UniqueNode");
+        {
+            auto intrusive = MakeIntrusive<IntrusiveNode>();
+            IntrusivePtr<IntrusiveNode> copy = intrusive;
+            UniquePtr<UniqueNode> unique(new UniqueNode);
+            UniquePtr<UniqueNode> moved(std::move(unique));
+        }
+        PtrTypeStats intrusive_after = StatsFor("IntrusiveNode");
+        PtrTypeStats unique_after = StatsFor("UniqueNode");
+        REQUIRE(intrusive_after.Get(PtrEvent::kBlockAllocated) -
+                    intrusive_before.Get(PtrEvent::kBlockAllocated) ==
+                1);
+        REQUIRE(intrusive_after.Get(PtrEvent::kCopy) - intrusive_before.Get(PtrEvent::kCopy) >= 1);
+        REQUIRE(intrusive_after.Get(PtrEvent::kDestroyed) -
+                    intrusive_before.Get(PtrEvent::kDestroyed) ==
+                1);
+        REQUIRE(unique_after.Get(PtrEvent::kMove) - unique_before.Get(PtrEvent::kMove) == 1);
+        REQUIRE(unique_after.Get(PtrEvent::kDestroyed) - unique_before.Get(PtrEvent::kDestroyed) ==
+                1);
+    }
+
+    SECTION("Counts of exited threads are kept") {
+        auto shared = MakeShared<SharedNode, MultiThreaded>();
+        PtrTypeStats before = StatsFor("SharedNode");
+        std::thread([shared] {
+            for (int i = 0; i < 100; ++i) {
+                SharedPtr<SharedNode, MultiThreaded> copy = shared;
+            }
+        }).join();
+        PtrTypeStats after = StatsFor("SharedNode");
+        // The lambda's own capture is one more copy, made on this thread
+        REQUIRE(after.Get(PtrEvent::kCopy) - before.Get(PtrEvent::kCopy) >= 100);
+    }
+}
+
+TEST_CASE("Snapshot formats") {
+    auto shared = MakeShared<SharedNode>();
+    SharedPtr<SharedNode> copy = shared;
+
+    auto snapshot = PtrStats::Snapshot();
+    REQUIRE(!snapshot.empty());
+    for (size_t i = 1; i < snapshot.size(); ++i) {
+        REQUIRE(snapshot[i - 1].Total() >= snapshot[i].Total());
+    }
+
+    std::string text = PtrStats::ToText(snapshot);
+    REQUIRE(text.find("copies  moves  locks  failed_locks  blocks_allocated  destroyed") !=
+            std::string::npos);
+    REQUIRE(text.find("SharedNode") != std::string::npos);
+
+    std::string json = PtrStats::ToJson(snapshot);
+    REQUIRE(json.rfind("{\"types\": [{\"type\": ", 0) == 0);
+    REQUIRE(json.find("\"type\": \"SharedNode\", \"copies\": ") != std::string::npos);
+    REQUIRE(json.back() == '}');
+}
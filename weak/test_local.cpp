@@ -0,0 +1,54 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <thread>
+#include <type_traits>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static_assert(std::is_same_v<LocalSharedPtr<int>, SharedPtr<int>>);
+static_assert(std::is_same_v<LocalWeakPtr<int>, WeakPtr<int>>);
+
+TEST_CASE("Local pointers") {
+    LocalSharedPtr<int> shared = MakeShared<int>(5);
+    LocalWeakPtr<int> weak(shared);
+    LocalSharedPtr<int> copy = weak.Lock();
+    REQUIRE(*copy == 5);
+    REQUIRE(shared.UseCount() == 2);
+    copy.Reset();
+    shared.Reset();
+    REQUIRE(weak.Expired());
+}
+
+#if SMART_POINTERS_CHECK_OWNER
+TEST_CASE("Local pointers used from another thread") {
+    static int violations = 0;
+    auto saved = SingleThreaded::on_foreign_thread;
+    SingleThreaded::on_foreign_thread = [] { ++violations; };
+
+    LocalSharedPtr<int> shared = MakeShared<int>(1);
+    std::thread([&shared] {
+        // Moves do not touch the counts
+        LocalSharedPtr<int> moved(std::move(shared));
+        shared = std::move(moved);
+    }).join();
+    REQUIRE(violations == 0);
+
+    std::thread([&shared] {
+        LocalSharedPtr<int> copy(shared);
+        LocalWeakPtr<int> weak(copy);
+    }).join();
+    // Only the copy: weak references and releases are not checked
+    REQUIRE(violations == 1);
+
+    // Handing the last reference to a worker that releases it
+    LocalWeakPtr<int> observer(shared);
+    std::thread([handed = std::move(shared)]() mutable { handed.Reset(); }).join();
+    REQUIRE(violations == 1);
+    REQUIRE(observer.Expired());
+
+    SingleThreaded::on_foreign_thread = saved;
+}
+#endif
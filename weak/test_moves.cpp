@@ -0,0 +1,109 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Single-threaded counts that record every counter update
+struct CountedOps {
+    static inline size_t updates = 0;
+
+    class RefCounts : public SingleThreaded::RefCounts {
+    public:
+        void IncStrong() {
+            ++updates;
+            SingleThreaded::RefCounts::IncStrong();
+        }
+        bool DecStrong() {
+            ++updates;
+            return SingleThreaded::RefCounts::DecStrong();
+        }
+        LockStatus TryIncStrong(bool retry) {
+            ++updates;
+            return SingleThreaded::RefCounts::TryIncStrong(retry);
+        }
+        void IncWeak() {
+            ++updates;
+            SingleThreaded::RefCounts::IncWeak();
+        }
+        bool DecWeak() {
+            ++updates;
+            return SingleThreaded::RefCounts::DecWeak();
+        }
+    };
+};
+
+struct MovedBase {
+    int base = 1;
+};
+
+struct MovedDerived : MovedBase {
+    int derived = 2;
+};
+
+// Counter updates made by `body`
+template <typename Body>
+size_t CountUpdates(Body body) {
+    size_t before = CountedOps::updates;
+    body();
+    return CountedOps::updates - before;
+}
+
+TEST_CASE("Moves do not touch the counters") {
+    auto source = MakeShared<MovedDerived, CountedOps>();
+    WeakPtr<MovedDerived, CountedOps> weak_source(source);
+
+    SECTION("SharedPtr") {
+        MovedDerived* raw = source.Get();
+        REQUIRE(CountUpdates([&] {
+                    SharedPtr<MovedDerived, CountedOps> moved(std::move(source));
+                    SharedPtr<MovedDerived, CountedOps> assigned;
+                    assigned = std::move(moved);
+                    SharedPtr<MovedBase, CountedOps> converted(std::move(assigned));
+                    SharedPtr<int, CountedOps> aliased(std::move(converted), &raw->derived);
+                    SharedPtr<int, CountedOps> other;
+                    aliased.Swap(other);
+                    std::swap(aliased, other);
+                    source = SharedPtr<MovedDerived, CountedOps>(std::move(aliased), raw);
+                }) == 0);
+        REQUIRE(source.UseCount() == 1);
+        REQUIRE(source->derived == 2);
+    }
+
+    SECTION("WeakPtr") {
+        REQUIRE(CountUpdates([&] {
+                    WeakPtr<MovedDerived, CountedOps> moved(std::move(weak_source));
+                    WeakPtr<MovedDerived, CountedOps> assigned;
+                    assigned = std::move(moved);
+                    WeakPtr<MovedBase, CountedOps> converted(std::move(assigned));
+                    WeakPtr<MovedBase, CountedOps> other;
+                    converted.Swap(other);
+                }) == 1);  // the weak reference itself is released at the end
+    }
+
+    SECTION("Self-assignment") {
+        auto& self = weak_source;
+        weak_source = self;
+        REQUIRE(weak_source.Lock() == source);
+        weak_source = std::move(self);
+        REQUIRE(weak_source.Lock() == source);
+        REQUIRE(source.UseCount() == 1);
+    }
+
+    SECTION("Returned by value") {
+        auto make = [] { return MakeShared<MovedDerived, CountedOps>(); };
+        // Only the final release: one strong and one weak decrement
+        REQUIRE(CountUpdates([&] { auto made = make(); }) == 2);
+        // One increment in `Lock()` and one decrement at the end of the scope
+        REQUIRE(CountUpdates([&] { auto locked = weak_source.Lock(); }) == 2);
+    }
+
+    SECTION("Vector growth") {
+        std::vector<SharedPtr<MovedDerived, CountedOps>> pointers(16, source);
+        REQUIRE(CountUpdates([&] { pointers.reserve(1024); }) == 0);
+    }
+}
@@ -0,0 +1,69 @@
+#include "shared.h"
+#include "weak.h"
+
+#include "allocations_checker.h"
+#include <catch.hpp>
+
+#include <common/block_pool.h>
+
+#include <memory>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Built with SMART_POINTERS_POOLED_BLOCKS only, next to the shared/weak tests
+
+struct PooledDeleter {
+    void operator()(int* ptr) const {
+        delete ptr;
+    }
+    int state = 0;
+};
+
+TEST_CASE("Pooled blocks are reused") {
+    SECTION("MakeShared") {
+        auto first = MakeShared<int>(1);
+        auto* block = first.block_;
+        first.Reset();
+        SharedPtr<int> second;
+        EXPECT_ZERO_ALLOCATIONS(second = MakeShared<int>(2));
+        REQUIRE(second.block_ == block);
+        REQUIRE(*second == 2);
+    }
+
+    SECTION("Adopted pointers and deleters") {
+        SharedPtr<int>(new int(1)).Reset();
+        SharedPtr<int>(new int(2), PooledDeleter{}).Reset();
+        BlockPoolStats before = BlockPool::Stats();
+        // Only the objects are allocated
+        EXPECT_ONE_ALLOCATION(SharedPtr<int>(new int(3)));
+        EXPECT_ONE_ALLOCATION((SharedPtr<int>(new int(4), PooledDeleter{})));
+        REQUIRE(BlockPool::Stats().hits - before.hits == 2);
+    }
+
+    SECTION("Arrays") {
+        MakeShared<int[]>(4).Reset();
+        SharedPtr<int[]> array;
+        EXPECT_ZERO_ALLOCATIONS(array = MakeShared<int[]>(4));
+        REQUIRE(array[3] == 0);
+    }
+
+    SECTION("Blocks kept alive by weak references") {
+        auto shared = MakeShared<int>(5);
+        WeakPtr<int> weak(shared);
+        auto* block = shared.block_;
+        shared.Reset();
+        REQUIRE(weak.Expired());
+        weak.Reset();
+        REQUIRE(MakeShared<int>(6).block_ == block);
+    }
+}
+
+TEST_CASE("Pooled blocks released on another thread") {
+    auto shared = MakeShared<int, MultiThreaded>(7);
+    WeakPtr<int, MultiThreaded> weak(shared);
+    std::thread([shared = std::move(shared)]() mutable { shared.Reset(); }).join();
+    REQUIRE(weak.Expired());
+    weak.Reset();
+    REQUIRE(*MakeShared<int, MultiThreaded>(8) == 8);
+}
@@ -0,0 +1,130 @@
+#include "rcu.h"
+#include "shared.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// A version whose fields must always agree, and that notices being read after destruction
+struct RoutingTable {
+    static constexpr int kAlive = 0x5eed;
+    static inline std::atomic<int> alive = 0;
+
+    explicit RoutingTable(int generation) : generation(generation), checksum(generation * 7) {
+        ++alive;
+    }
+    ~RoutingTable() {
+        magic = 0;
+        --alive;
+    }
+
+    bool Consistent() const {
+        return magic == kAlive && checksum == generation * 7;
+    }
+
+    int magic = kAlive;
+    int generation;
+    int checksum;
+};
+
+using TablePtr = SharedPtr<RoutingTable, MultiThreaded>;
+
+TEST_CASE("RcuPtr publishes versions") {
+    {
+        RcuPtr<RoutingTable> table;
+        REQUIRE(!table.ReadLock());
+        REQUIRE(!table.Load());
+
+        table.Publish(MakeShared<RoutingTable, MultiThreaded>(1));
+        {
+            auto guard = table.ReadLock();
+            REQUIRE(guard->generation == 1);
+            REQUIRE(guard.Share().UseCount() == 2);
+        }
+        table.Publish(MakeShared<RoutingTable, MultiThreaded>(2));
+        REQUIRE(table.ReadLock()->generation == 2);
+        REQUIRE(table.Retired() == 0);
+        REQUIRE(RoutingTable::alive == 1);
+    }
+    REQUIRE(RoutingTable::alive == 0);
+}
+
+TEST_CASE("RcuPtr keeps versions for readers") {
+    RcuPtr<RoutingTable> table(MakeShared<RoutingTable, MultiThreaded>(1));
+    {
+        auto guard = table.ReadLock();
+        table.Publish(MakeShared<RoutingTable, MultiThreaded>(2));
+        table.Publish(MakeShared<RoutingTable, MultiThreaded>(3));
+        REQUIRE(table.Retired() == 2);
+        REQUIRE(RoutingTable::alive == 3);
+        REQUIRE(guard->generation == 1);
+
+        // Nested sections see the newest version
+        auto nested = table.ReadLock();
+        REQUIRE(nested->generation == 3);
+    }
+    table.Synchronize();
+    REQUIRE(table.Retired() == 0);
+    REQUIRE(RoutingTable::alive == 1);
+
+    TablePtr snapshot = table.Load();
+    table.Publish(MakeShared<RoutingTable, MultiThreaded>(4));
+    REQUIRE(table.Retired() == 0);
+    REQUIRE(snapshot->generation == 3);
+    REQUIRE(RoutingTable::alive == 2);
+}
+
+TEST_CASE("RcuPtr stress") {
+    constexpr int kReaders = 6;
+    constexpr int kVersions = 2000;
+    {
+        RcuPtr<RoutingTable> table(MakeShared<RoutingTable, MultiThreaded>(0));
+        std::atomic<bool> done = false;
+        std::atomic<int> inconsistent = 0;
+        std::atomic<int> backwards = 0;
+        std::vector<std::thread> readers;
+        for (int i = 0; i < kReaders; ++i) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    auto guard = table.ReadLock();
+                    if (!guard->Consistent()) {
+                        ++inconsistent;
+                    }
+                    if (guard->generation < last) {
+                        ++backwards;
+                    }
+                    last = guard->generation;
+                    if (last % 64 == 0) {
+                        TablePtr snapshot = guard.Share();
+                        std::this_thread::yield();
+                        if (!snapshot->Consistent()) {
+                            ++inconsistent;
+                        }
+                    }
+                }
+            });
+        }
+        std::thread writer([&] {
+            for (int generation = 1; generation <= kVersions; ++generation) {
+                table.Publish(MakeShared<RoutingTable, MultiThreaded>(generation));
+                if (generation % 256 == 0) {
+                    table.Synchronize();
+                }
+            }
+            done = true;
+        });
+        writer.join();
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(inconsistent == 0);
+        REQUIRE(backwards == 0);
+        REQUIRE(table.ReadLock()->generation == kVersions);
+    }
+    REQUIRE(RoutingTable::alive == 0);
+}
@@ -0,0 +1,144 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/reclaimer.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+using ReclaimedPtr = SharedPtr<T, Reclaimed<>>;
+
+static_assert(Reclaimed<>::kThreadSafe && Reclaimed<Packed>::kThreadSafe);
+
+struct Graph {
+    static inline std::atomic<int> alive = 0;
+    static inline std::thread::id destroyed_on;
+
+    Graph() {
+        ++alive;
+    }
+    ~Graph() {
+        destroyed_on = std::this_thread::get_id();
+        --alive;
+    }
+
+    ReclaimedPtr<Graph> child;
+};
+
+TEST_CASE("Reclaimed releases") {
+    SECTION("Destructor runs on the reclaimer thread") {
+        auto graph = MakeShared<Graph, Reclaimed<>>();
+        WeakPtr<Graph, Reclaimed<>> weak(graph);
+        graph.Reset();
+        REQUIRE(weak.Expired());
+
+        Reclaimer::Default().Drain();
+        REQUIRE(Graph::alive == 0);
+        REQUIRE(Graph::destroyed_on != std::this_thread::get_id());
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Nested releases") {
+        ReclaimedPtr<Graph> root(new Graph);
+        Graph* node = root.Get();
+        for (int i = 0; i < 100; ++i) {
+            node->child = ReclaimedPtr<Graph>(new Graph);
+            node = node->child.Get();
+        }
+        REQUIRE(Graph::alive == 101);
+        root.Reset();
+        Reclaimer::Default().Drain();
+        REQUIRE(Graph::alive == 0);
+    }
+
+    SECTION("Many threads") {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 4; ++i) {
+            workers.emplace_back([] {
+                for (int j = 0; j < 2000; ++j) {
+                    auto graph = MakeShared<Graph, Reclaimed<>>();
+                    auto copy = graph;
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        Reclaimer::Default().Drain();
+        REQUIRE(Graph::alive == 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Gate {
+    std::atomic<bool> started = false;
+    std::atomic<bool> open = false;
+    std::atomic<int> ran = 0;
+
+    static void Wait(void* gate) {
+        auto* self = static_cast<Gate*>(gate);
+        self->started = true;
+        while (!self->open) {
+            std::this_thread::yield();
+        }
+        ++self->ran;
+    }
+    static void Count(void* gate) {
+        ++static_cast<Gate*>(gate)->ran;
+    }
+};
+
+TEST_CASE("Reclaimer") {
+    Gate gate;
+
+    SECTION("Runs inline when full") {
+        Reclaimer reclaimer(1, Reclaimer::Backpressure::kRunInline);
+        reclaimer.Submit(&Gate::Wait, &gate);
+        // Wait for the thread to take the blocking task, freeing the only slot
+        while (!gate.started) {
+        }
+        reclaimer.Submit(&Gate::Count, &gate);
+        reclaimer.Submit(&Gate::Count, &gate);
+        // Checked without stopping the test, which would leave the thread waiting
+        CHECK(gate.ran == 1);
+        gate.open = true;
+        reclaimer.Drain();
+        REQUIRE(gate.ran == 3);
+        REQUIRE(reclaimer.Pending() == 0);
+    }
+
+    SECTION("Blocks when full") {
+        Reclaimer reclaimer(1);
+        reclaimer.Submit(&Gate::Wait, &gate);
+        reclaimer.Submit(&Gate::Count, &gate);
+        std::atomic<bool> submitted = false;
+        std::thread producer([&] {
+            reclaimer.Submit(&Gate::Count, &gate);
+            submitted = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(!submitted);
+        gate.open = true;
+        producer.join();
+        reclaimer.Drain();
+        REQUIRE(gate.ran == 3);
+    }
+
+    SECTION("Stop drains, then runs inline") {
+        Reclaimer reclaimer;
+        gate.open = true;
+        for (int i = 0; i < 10; ++i) {
+            reclaimer.Submit(&Gate::Count, &gate);
+        }
+        reclaimer.Stop();
+        REQUIRE(gate.ran == 10);
+        reclaimer.Submit(&Gate::Count, &gate);
+        REQUIRE(gate.ran == 11);
+    }
+}
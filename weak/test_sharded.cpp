@@ -0,0 +1,97 @@
+#include "shared.h"
+#include "sharded.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Sharded counts before retirement") {
+    const int alive_before = MyInt::AliveCount();
+    auto owner = MakeSharded<MyInt>(42);
+    REQUIRE(owner.UseCount() == 1);
+    {
+        auto copy = owner;
+        auto another = copy;
+        REQUIRE(owner.UseCount() == 3);
+        REQUIRE(*another == 42);
+    }
+    REQUIRE(owner.UseCount() == 1);
+
+    // Copies dropped on another thread land in another shard
+    auto copy = owner;
+    std::thread([moved = std::move(copy)]() mutable { moved.Reset(); }).join();
+    REQUIRE(owner.UseCount() == 1);
+
+    Retire(owner);
+    REQUIRE(!owner);
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+TEST_CASE("Sharded objects outlive retirement while copied") {
+    const int alive_before = MyInt::AliveCount();
+    auto owner = MakeSharded<MyInt>(1);
+    WeakPtr<MyInt, Sharded<>> weak = owner;
+    auto copy = owner;
+
+    Retire(owner);
+    REQUIRE(MyInt::AliveCount() == alive_before + 1);
+    REQUIRE(copy.UseCount() == 1);
+    REQUIRE(!weak.Expired());
+
+    auto locked = weak.Lock();
+    REQUIRE(copy.UseCount() == 2);
+    locked.Reset();
+    copy.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+TEST_CASE("Retiring twice releases both references") {
+    const int alive_before = MyInt::AliveCount();
+    auto owner = MakeShared<MyInt, Sharded<4>>(2);
+    ShardedSharedPtr<MyInt, 4> second = owner;
+    Retire(owner);
+    REQUIRE(MyInt::AliveCount() == alive_before + 1);
+    Retire(second);
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+TEST_CASE("Retiring while other threads copy") {
+    const int alive_before = MyInt::AliveCount();
+    auto owner = MakeSharded<MyInt>(3);
+    WeakPtr<MyInt, Sharded<>> weak = owner;
+    std::atomic<int> started = 0;
+    std::atomic<int> failed_locks = 0;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 8; ++i) {
+        workers.emplace_back([shared = owner, &weak, &started, &failed_locks]() mutable {
+            ++started;
+            for (int j = 0; j < 10000; ++j) {
+                ShardedSharedPtr<MyInt> copy = shared;
+                if (!weak.Lock()) {
+                    ++failed_locks;
+                }
+            }
+            shared.Reset();
+        });
+    }
+    while (started < 8) {
+        std::this_thread::yield();
+    }
+    Retire(owner);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(failed_locks == 0);
+    REQUIRE(weak.Expired());
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
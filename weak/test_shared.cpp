@@ -330,7 +330,12 @@ struct Throwing {
 
 TEST_CASE("MakeShared") {
     SECTION("One allocation") {
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+        // The block comes from a slab the pool carved in advance
+        REQUIRE(*MakeShared<int>(42) == 42);
+#else
         EXPECT_ONE_ALLOCATION(REQUIRE(*MakeShared<int>(42) == 42));
+#endif
     }
 
     SECTION("Parameters passing") {
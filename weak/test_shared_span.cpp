@@ -0,0 +1,133 @@
+#include "shared.h"
+#include "shared_span.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Counts the updates made to any strong counter
+struct BatchCounted {
+    static inline size_t updates = 0;
+
+    class RefCounts : public SingleThreaded::RefCounts {
+    public:
+        void IncStrong() {
+            ++updates;
+            SingleThreaded::RefCounts::IncStrong();
+        }
+        bool DecStrong() {
+            ++updates;
+            return SingleThreaded::RefCounts::DecStrong();
+        }
+        void AddStrong(size_t count) {
+            ++updates;
+            SingleThreaded::RefCounts::AddStrong(count);
+        }
+        bool SubStrong(size_t count) {
+            ++updates;
+            return SingleThreaded::RefCounts::SubStrong(count);
+        }
+    };
+};
+
+using BatchPtr = SharedPtr<MyInt, BatchCounted>;
+
+// `count` pointers cycling through `sources`
+std::vector<BatchPtr> FanOut(const std::vector<BatchPtr>& sources, size_t count) {
+    std::vector<BatchPtr> result;
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back(sources[i % sources.size()]);
+    }
+    return result;
+}
+
+TEST_CASE("Span operations") {
+    const int alive_before = MyInt::AliveCount();
+    {
+        std::vector<BatchPtr> sources;
+        for (int i = 0; i < 3; ++i) {
+            sources.push_back(MakeShared<MyInt, BatchCounted>(i));
+        }
+        std::vector<BatchPtr> fan_out = FanOut(sources, 3000);
+        fan_out.push_back(nullptr);
+
+        SECTION("CopySpan") {
+            std::vector<BatchPtr> copy(fan_out.size());
+            size_t before = BatchCounted::updates;
+            CopySpan(fan_out.data(), fan_out.size(), copy.data());
+            REQUIRE(BatchCounted::updates - before == 3);
+            REQUIRE(copy == fan_out);
+            REQUIRE(sources[0].UseCount() == 1 + 2 * 1000);
+        }
+
+        SECTION("DestroySpan") {
+            size_t before = BatchCounted::updates;
+            DestroySpan(fan_out.data(), fan_out.size());
+            REQUIRE(BatchCounted::updates - before == 3);
+            REQUIRE(!fan_out[0]);
+            REQUIRE(sources[1].UseCount() == 1);
+
+            // Releases the last references
+            sources.push_back(MakeShared<MyInt, BatchCounted>(3));
+            REQUIRE(MyInt::AliveCount() == alive_before + 4);
+            DestroySpan(sources.data(), sources.size());
+            REQUIRE(MyInt::AliveCount() == alive_before);
+        }
+
+        SECTION("AssignSpan") {
+            std::vector<BatchPtr> target = FanOut({sources[2], sources[1]}, fan_out.size());
+            size_t before = BatchCounted::updates;
+            AssignSpan(fan_out.data(), fan_out.size(), target.data());
+            REQUIRE(BatchCounted::updates - before <= 3);
+            REQUIRE(target == fan_out);
+            REQUIRE(sources[0].UseCount() == 1 + 2 * 1000);
+            REQUIRE(sources[2].UseCount() == 1 + 2 * 1000);
+
+            // The same range: nothing changes
+            before = BatchCounted::updates;
+            AssignSpan(target.data(), target.size(), target.data());
+            REQUIRE(BatchCounted::updates == before);
+            REQUIRE(target == fan_out);
+        }
+
+        SECTION("More distinct blocks than slots") {
+            std::vector<BatchPtr> many;
+            for (int i = 0; i < 100; ++i) {
+                many.push_back(MakeShared<MyInt, BatchCounted>(i));
+            }
+            std::vector<BatchPtr> copy(many.size());
+            CopySpan(many.data(), many.size(), copy.data());
+            REQUIRE(many[99].UseCount() == 2);
+            DestroySpan(many.data(), many.size());
+            REQUIRE(copy[99].UseCount() == 1);
+            REQUIRE(MyInt::AliveCount() == alive_before + 103);
+        }
+    }
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+TEST_CASE("Span operations with atomic counts") {
+    auto shared = MakeShared<int, MultiThreaded>(1);
+    std::vector<SharedPtr<int, MultiThreaded>> source(1000, shared);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; ++i) {
+        workers.emplace_back([&source] {
+            for (int j = 0; j < 100; ++j) {
+                std::vector<SharedPtr<int, MultiThreaded>> copy(source.size());
+                CopySpan(source.data(), source.size(), copy.data());
+                DestroySpan(copy.data(), copy.size());
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(shared.UseCount() == 1001);
+}
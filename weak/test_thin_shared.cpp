@@ -0,0 +1,164 @@
+#include "shared.h"
+#include "thin_shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct ThinBase {
+    virtual ~ThinBase() = default;
+    int base = 1;
+};
+
+struct ThinDerived : ThinBase {
+    int derived = 2;
+};
+
+struct ThinOther {
+    virtual ~ThinOther() = default;
+    int other = 3;
+};
+
+// `ThinBase` is not at the start of the object
+struct ThinMultiple : ThinOther, ThinBase {};
+
+TEST_CASE("ThinSharedPtr is one word") {
+    REQUIRE(sizeof(ThinSharedPtr<MyInt>) == sizeof(void*));
+    REQUIRE(sizeof(ThinWeakPtr<MyInt>) == sizeof(void*));
+
+    ThinSharedPtr<MyInt> empty;
+    REQUIRE(!empty);
+    REQUIRE(empty.Get() == nullptr);
+    REQUIRE(empty.UseCount() == 0);
+    REQUIRE(!empty.ToShared());
+    REQUIRE(ThinWeakPtr<MyInt>(empty).Expired());
+}
+
+TEST_CASE("ThinSharedPtr copy/move") {
+    auto a = MakeThinShared<std::string>("abacaba");
+    ThinSharedPtr<std::string> b = a;
+    ThinSharedPtr<std::string> c = std::move(a);
+    REQUIRE(!a);
+    REQUIRE(c.UseCount() == 2);
+    REQUIRE(*b == "abacaba");
+    REQUIRE(c->size() == 7);
+    REQUIRE(b == c);
+
+    auto d = MakeThinShared<std::string>("karabas");
+    b = d;
+    REQUIRE(c.UseCount() == 1);
+    REQUIRE(*b == "karabas");
+
+    b.Swap(c);
+    REQUIRE(*b == "abacaba");
+    c.Reset();
+    REQUIRE(!c);
+    REQUIRE(d.UseCount() == 1);
+}
+
+TEST_CASE("ThinSharedPtr finds the object in every block") {
+    SECTION("MakeShared") {
+        auto full = MakeShared<MyInt>(1);
+        ThinSharedPtr<MyInt> thin(full);
+        REQUIRE(thin.Get() == full.Get());
+    }
+
+    SECTION("Separate storage") {
+        auto full = MakeSharedSeparate<MyInt>(2);
+        ThinSharedPtr<MyInt> thin(full);
+        REQUIRE(thin.Get() == full.Get());
+    }
+
+    SECTION("Raw pointer with a deleter") {
+        bool deleted = false;
+        SharedPtr<int> full(new int(3), [&deleted](int* ptr) {
+            deleted = true;
+            delete ptr;
+        });
+        ThinSharedPtr<int> thin(std::move(full));
+        REQUIRE(!full);
+        REQUIRE(*thin == 3);
+        thin.Reset();
+        REQUIRE(deleted);
+    }
+
+    SECTION("AllocateShared") {
+        auto full = AllocateShared<MyInt>(std::allocator<MyInt>(), 4);
+        ThinSharedPtr<MyInt> thin(full);
+        REQUIRE(thin.Get() == full.Get());
+    }
+
+    SECTION("Base at the same address") {
+        SharedPtr<ThinBase> full(new ThinDerived);
+        REQUIRE(ThinSharedPtr<ThinBase>::Fits(full));
+        ThinSharedPtr<ThinBase> thin(full);
+        REQUIRE(thin->base == 1);
+    }
+    REQUIRE(MyInt::AliveCount() == 0);
+}
+
+TEST_CASE("ThinSharedPtr does not fit aliases") {
+    auto owner = MakeShared<std::vector<int>>(3, 7);
+    SharedPtr<int> alias(owner, owner->data() + 1);
+    REQUIRE(!ThinSharedPtr<int>::Fits(alias));
+
+    SharedPtr<ThinBase> shifted(new ThinMultiple);
+    REQUIRE(!ThinSharedPtr<ThinBase>::Fits(shifted));
+
+    REQUIRE(ThinSharedPtr<int>::Fits(SharedPtr<int>()));
+
+    REQUIRE_THROWS_AS(ThinSharedPtr<int>(alias), std::invalid_argument);
+    REQUIRE_THROWS_AS(ThinSharedPtr<int>(std::move(alias)), std::invalid_argument);
+    REQUIRE(alias.Get() == owner->data() + 1);
+    REQUIRE(owner.UseCount() == 2);
+
+    REQUIRE_THROWS_AS(ThinSharedPtr<ThinBase>(shifted), std::invalid_argument);
+    REQUIRE(shifted.UseCount() == 1);
+
+    WeakPtr<int> weak_alias(alias);
+    REQUIRE(!ThinWeakPtr<int>::Fits(weak_alias));
+    REQUIRE_THROWS_AS(ThinWeakPtr<int>(weak_alias), std::invalid_argument);
+    REQUIRE(ThinWeakPtr<int>::Fits(WeakPtr<int>()));
+}
+
+TEST_CASE("ThinSharedPtr converts to SharedPtr") {
+    auto thin = MakeThinShared<MyInt>(5);
+    SharedPtr<MyInt> full = thin.ToShared();
+    REQUIRE(full.Get() == thin.Get());
+    REQUIRE(full.UseCount() == 2);
+    ThinSharedPtr<MyInt> back;
+    EXPECT_ZERO_ALLOCATIONS((back = ThinSharedPtr<MyInt>(std::move(full))));
+    REQUIRE(thin.UseCount() == 2);
+}
+
+TEST_CASE("ThinWeakPtr") {
+    ThinWeakPtr<MyInt> weak;
+    {
+        auto thin = MakeThinShared<MyInt>(6);
+        weak = thin;
+        REQUIRE(!weak.Expired());
+        REQUIRE(weak.UseCount() == 1);
+
+        auto locked = weak.Lock();
+        REQUIRE(locked == thin);
+        REQUIRE(thin.UseCount() == 2);
+
+        WeakPtr<MyInt> full = weak.ToWeak();
+        REQUIRE(full.Lock().Get() == thin.Get());
+        ThinWeakPtr<MyInt> back(full);
+        REQUIRE(back.Lock().Get() == thin.Get());
+    }
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+    REQUIRE(MyInt::AliveCount() == 0);
+}
@@ -0,0 +1,279 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+using ConcurrentSharedPtr = SharedPtr<T, MultiThreaded>;
+
+template <typename T>
+using ConcurrentWeakPtr = WeakPtr<T, MultiThreaded>;
+
+TEST_CASE("Concurrent copies") {
+    const int alive_before = MyInt::AliveCount();
+    {
+        auto shared = MakeShared<MyInt, MultiThreaded>(42);
+        ConcurrentWeakPtr<MyInt> weak(shared);
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 8; ++i) {
+            workers.emplace_back([shared] {
+                for (int j = 0; j < 10000; ++j) {
+                    ConcurrentSharedPtr<MyInt> copy = shared;
+                    ConcurrentWeakPtr<MyInt> weak_copy(copy);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        REQUIRE(shared.UseCount() == 1);
+        REQUIRE(weak.UseCount() == 1);
+        REQUIRE(MyInt::AliveCount() == alive_before + 1);
+    }
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+TEST_CASE("Last owner released on another thread") {
+    const int alive_before = MyInt::AliveCount();
+    ConcurrentWeakPtr<MyInt> weak;
+    {
+        ConcurrentSharedPtr<MyInt> shared(new MyInt(1));
+        weak = ConcurrentWeakPtr<MyInt>(shared);
+        std::thread([moved = std::move(shared)]() mutable { moved.Reset(); }).join();
+    }
+    REQUIRE(weak.Expired());
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Node {
+    WeakPtr<Node> self;
+};
+
+TEST_CASE("Object holding the last weak reference to its own block") {
+    SharedPtr<Node> node(new Node);
+    node->self = WeakPtr<Node>(node);
+    REQUIRE(node.UseCount() == 1);
+    REQUIRE(node.block_->GetWeakCounter() == 1);
+    node.Reset();
+
+    auto made = MakeShared<Node>();
+    made->self = WeakPtr<Node>(made);
+    made.Reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Biased counts") {
+    const int alive_before = MyInt::AliveCount();
+
+    SECTION("Owner thread only") {
+        auto shared = MakeShared<MyInt, Biased>(1);
+        {
+            SharedPtr<MyInt, Biased> copy = shared;
+            REQUIRE(shared.UseCount() == 2);
+        }
+        REQUIRE(shared.UseCount() == 1);
+    }
+
+    SECTION("Released by other threads before the owner") {
+        SharedPtr<MyInt, Biased> shared(new MyInt(2));
+        WeakPtr<MyInt, Biased> weak(shared);
+        std::vector<SharedPtr<MyInt, Biased>> owned_copies(8, shared);
+        std::vector<std::thread> workers;
+        for (auto& copy : owned_copies) {
+            workers.emplace_back([moved = std::move(copy)]() mutable {
+                for (int j = 0; j < 1000; ++j) {
+                    SharedPtr<MyInt, Biased> local = moved;
+                }
+                moved.Reset();
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        // The copies were made here, so their releases are queued to this thread
+        REQUIRE(shared.UseCount() == 9);
+        Biased::MergeQueued();
+        REQUIRE(shared.UseCount() == 1);
+        shared.Reset();
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Last reference outlives the owner's") {
+        SharedPtr<MyInt, Biased> shared(new MyInt(3));
+        SharedPtr<MyInt, Biased> escaped = shared;
+        shared.Reset();
+        std::thread([moved = std::move(escaped)]() mutable {
+            SharedPtr<MyInt, Biased> local = moved;
+            moved.Reset();
+        }).join();
+
+        // The escaped reference was accounted on this thread
+        REQUIRE(MyInt::AliveCount() == alive_before + 1);
+        Biased::MergeQueued();
+    }
+
+    SECTION("Owner exits first") {
+        SharedPtr<MyInt, Biased> escaped;
+        std::thread([&escaped] {
+            SharedPtr<MyInt, Biased> shared(new MyInt(4));
+            escaped = shared;
+        }).join();
+        REQUIRE(escaped.UseCount() == 1);
+        escaped.Reset();
+    }
+
+    SECTION("Counts after the owner exits") {
+        std::vector<SharedPtr<MyInt, Biased>> escaped;
+        std::thread([&escaped] {
+            SharedPtr<MyInt, Biased> shared(new MyInt(5));
+            escaped.assign(3, shared);
+        }).join();
+        REQUIRE(escaped[0].UseCount() == 3);
+        // The first release here folds the owner's biased count into the shared counter
+        escaped.pop_back();
+        REQUIRE(escaped[0].UseCount() == 2);
+        escaped.pop_back();
+        REQUIRE(escaped[0].UseCount() == 1);
+        escaped.clear();
+    }
+
+    REQUIRE(MyInt::AliveCount() == alive_before);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Packed counts") {
+    const int alive_before = MyInt::AliveCount();
+    REQUIRE(sizeof(ControlBlockPointer<MyInt, Packed>) + sizeof(size_t) ==
+            sizeof(ControlBlockPointer<MyInt, MultiThreaded>));
+    {
+        auto shared = MakeShared<MyInt, Packed>(5);
+        WeakPtr<MyInt, Packed> weak(shared);
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 8; ++i) {
+            workers.emplace_back([shared] {
+                for (int j = 0; j < 10000; ++j) {
+                    SharedPtr<MyInt, Packed> copy = shared;
+                    WeakPtr<MyInt, Packed> weak_copy(copy);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        REQUIRE(shared.UseCount() == 1);
+        REQUIRE(shared.block_->GetWeakCounter() == 1);
+        shared.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(MyInt::AliveCount() == alive_before);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Readers keep locking a weak pointer while the main thread drops the only strong one: every
+// `Lock()` either fails or returns a live object, and the object is destroyed exactly once
+template <typename Policy>
+void LockRacingLastReset() {
+    const int alive_before = MyInt::AliveCount();
+    for (int round = 0; round < 200; ++round) {
+        auto shared = MakeShared<MyInt, Policy>(42);
+        WeakPtr<MyInt, Policy> weak(shared);
+        std::atomic<int> started = 0;
+        std::atomic<int> bad_reads = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&weak, &started, &bad_reads] {
+                ++started;
+                while (auto locked = weak.Lock()) {
+                    if (!(*locked == 42)) {
+                        ++bad_reads;
+                    }
+                }
+            });
+        }
+        while (started < 4) {
+        }
+        shared.Reset();
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        REQUIRE(bad_reads == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(MyInt::AliveCount() == alive_before);
+    }
+}
+
+TEST_CASE("Lock racing the last Reset") {
+    SECTION("MultiThreaded") {
+        LockRacingLastReset<MultiThreaded>();
+    }
+    SECTION("Packed") {
+        LockRacingLastReset<Packed>();
+    }
+    SECTION("Biased") {
+        LockRacingLastReset<Biased>();
+    }
+}
+
+TEST_CASE("TryLock") {
+    auto shared = MakeShared<MyInt, MultiThreaded>(7);
+    ConcurrentWeakPtr<MyInt> weak(shared);
+
+    ConcurrentSharedPtr<MyInt> locked;
+    REQUIRE(weak.TryLock(locked) == LockStatus::kLocked);
+    REQUIRE(locked.Get() == shared.Get());
+    REQUIRE(shared.UseCount() == 2);
+
+    // The previous contents of `result` are released on success
+    REQUIRE(weak.TryLock(locked) == LockStatus::kLocked);
+    REQUIRE(shared.UseCount() == 2);
+
+    locked.Reset();
+    shared.Reset();
+    REQUIRE(weak.TryLock(locked) == LockStatus::kExpired);
+    REQUIRE(!locked);
+    REQUIRE(ConcurrentWeakPtr<MyInt>().TryLock(locked) == LockStatus::kExpired);
+
+    // Under contention every attempt ends in one of the three outcomes, and a failed one
+    // leaves no reference behind
+    auto contended = MakeShared<MyInt, MultiThreaded>(8);
+    ConcurrentWeakPtr<MyInt> contended_weak(contended);
+    std::atomic<int> locks = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; ++i) {
+        workers.emplace_back([&contended_weak, &locks] {
+            for (int j = 0; j < 10000; ++j) {
+                ConcurrentSharedPtr<MyInt> result;
+                LockStatus status = contended_weak.TryLock(result);
+                if (status == LockStatus::kLocked) {
+                    ++locks;
+                } else if (status == LockStatus::kExpired || result) {
+                    locks = -1000000;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(locks > 0);
+    REQUIRE(contended.UseCount() == 1);
+}
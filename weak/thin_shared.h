@@ -0,0 +1,261 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// `SharedPtr` and `WeakPtr` in one word: only the block is stored, and the object's address
+// is asked from the block (`BlockOp::kGetObject`). Blocks that `MakeShared` places `T` in are
+// recognized by their manager and answered inline; any other block costs an indirect call.
+//
+// A thin pointer cannot alias, nor point to a base subobject at another address than the
+// owned object, so the full pointers convert to it only when `Fits` holds; otherwise the
+// conversion throws `std::invalid_argument`.
+
+// The object owned by `block`, seen as a `T`
+template <typename T, typename Policy>
+T* ThinObject(BaseBlock<Policy>* block) {
+    if (block == nullptr) {
+        return nullptr;
+    }
+    if constexpr (!std::is_abstract_v<T>) {
+        using InPlace = ControlBlockObject<T, Policy>;
+        if (block->manager_ == &InPlace::Manage) {
+            return reinterpret_cast<T*>(&static_cast<InPlace*>(block)->buffer_);
+        }
+    }
+    return static_cast<T*>(block->manager_(block, BlockOp::kGetObject, nullptr));
+}
+
+template <typename T, typename Policy = SingleThreaded>
+class ThinSharedPtr {
+    static_assert(!std::is_array_v<T>, "arrays keep using SharedPtr");
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    ThinSharedPtr() = default;
+    ThinSharedPtr(std::nullptr_t){};
+    explicit ThinSharedPtr(const SharedPtr<T, Policy>& other) : block_(Checked(other)) {
+        if (block_ != nullptr) {
+            block_->IncStrongCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    };
+    explicit ThinSharedPtr(SharedPtr<T, Policy>&& other) : block_(Checked(other)) {
+        other.block_ = nullptr;
+        other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
+    ThinSharedPtr(const ThinSharedPtr& other) : block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncStrongCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+    ThinSharedPtr(ThinSharedPtr&& other) noexcept : block_(other.block_) {
+        other.block_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    }
+
+    // Whether `ptr` points to the object its block owns, or is empty
+    static bool Fits(const SharedPtr<T, Policy>& ptr) {
+        return ThinObject<T>(ptr.block_) == ptr.Get();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    ThinSharedPtr& operator=(const ThinSharedPtr& other) {
+        ThinSharedPtr(other).Swap(*this);
+        return *this;
+    }
+    ThinSharedPtr& operator=(ThinSharedPtr&& other) noexcept {
+        ThinSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~ThinSharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_ != nullptr) {
+            std::exchange(block_, nullptr)->DecStrongCounter();
+        }
+    }
+    void Swap(ThinSharedPtr& other) noexcept {
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return ThinObject<T>(block_);
+    }
+    T& operator*() const {
+        return *Get();
+    }
+    T* operator->() const {
+        return Get();
+    }
+    size_t UseCount() const {
+        if (block_ == nullptr) {
+            return 0;
+        }
+        return block_->GetStrongCounter();
+    }
+    explicit operator bool() const {
+        return block_ != nullptr;
+    }
+    // A full-width pointer sharing ownership
+    SharedPtr<T, Policy> ToShared() const {
+        SharedPtr<T, Policy> result;
+        if (block_ != nullptr) {
+            block_->IncStrongCounter();
+            result.block_ = block_;
+            result.observed_ = Get();
+        }
+        return result;
+    }
+
+    BaseBlock<Policy>* block_ = nullptr;
+
+private:
+    static BaseBlock<Policy>* Checked(const SharedPtr<T, Policy>& ptr) {
+        if (!Fits(ptr)) {
+            throw std::invalid_argument("ThinSharedPtr: pointer is not the owned object");
+        }
+        return ptr.block_;
+    }
+};
+
+template <typename T, typename Policy>
+inline bool operator==(const ThinSharedPtr<T, Policy>& left,
+                       const ThinSharedPtr<T, Policy>& right) {
+    return left.block_ == right.block_;
+}
+
+template <typename T, typename Policy = SingleThreaded>
+class ThinWeakPtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    ThinWeakPtr() = default;
+    ThinWeakPtr(const ThinSharedPtr<T, Policy>& other) : block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncWeakCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    };
+    explicit ThinWeakPtr(const WeakPtr<T, Policy>& other) : block_(other.block_) {
+        if (!Fits(other)) {
+            throw std::invalid_argument("ThinWeakPtr: pointer is not the owned object");
+        }
+        if (block_ != nullptr) {
+            block_->IncWeakCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    };
+    ThinWeakPtr(const ThinWeakPtr& other) : block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncWeakCounter();
+        }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
+    }
+    ThinWeakPtr(ThinWeakPtr&& other) noexcept : block_(other.block_) {
+        other.block_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    }
+
+    // Whether `ptr` observes the object its block owns, or is empty
+    static bool Fits(const WeakPtr<T, Policy>& ptr) {
+        return ThinObject<T>(ptr.block_) == ptr.observed_;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    ThinWeakPtr& operator=(const ThinWeakPtr& other) {
+        ThinWeakPtr(other).Swap(*this);
+        return *this;
+    }
+    ThinWeakPtr& operator=(ThinWeakPtr&& other) noexcept {
+        ThinWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~ThinWeakPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_ != nullptr) {
+            std::exchange(block_, nullptr)->DecWeakCounter();
+        }
+    }
+    void Swap(ThinWeakPtr& other) noexcept {
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t UseCount() const {
+        if (block_ == nullptr) {
+            return 0;
+        }
+        return block_->GetStrongCounter();
+    }
+    bool Expired() const {
+        return UseCount() == 0;
+    }
+    // Safe against a concurrent release of the last strong reference
+    ThinSharedPtr<T, Policy> Lock() const {
+        RecordPtrEvent<T>(PtrEvent::kLock);
+        ThinSharedPtr<T, Policy> result;
+        if (block_ != nullptr && block_->TryIncStrongCounter(true) == LockStatus::kLocked) {
+            result.block_ = block_;
+        } else {
+            RecordPtrEvent<T>(PtrEvent::kLockFailed);
+        }
+        return result;
+    }
+    // A full-width weak reference to the same object
+    WeakPtr<T, Policy> ToWeak() const {
+        WeakPtr<T, Policy> result;
+        if (block_ != nullptr) {
+            block_->IncWeakCounter();
+            result.block_ = block_;
+            result.observed_ = ThinObject<T>(block_);
+        }
+        return result;
+    }
+
+    BaseBlock<Policy>* block_ = nullptr;
+};
+
+// `MakeShared` straight into a thin pointer
+template <typename T, typename Policy = SingleThreaded, typename... Args>
+ThinSharedPtr<T, Policy> MakeThinShared(Args&&... args) {
+    return ThinSharedPtr<T, Policy>(MakeShared<T, Policy>(std::forward<Args>(args)...));
+}
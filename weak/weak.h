@@ -4,13 +4,13 @@
 #include "shared.h"
 
 // https://en.cppreference.com/w/cpp/memory/weak_ptr
-template <typename T>
+template <typename T, typename Policy>
 class WeakPtr {
 public:
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
 
-    WeakPtr() : observed_(nullptr), block_(nullptr){};
+    WeakPtr() : block_(nullptr), observed_(nullptr){};
 
     WeakPtr(const WeakPtr& other) {
         block_ = other.block_;
@@ -18,42 +18,51 @@ public:
         if (block_ != nullptr) {
             block_->IncWeakCounter();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
-    WeakPtr(WeakPtr&& other) {
+    WeakPtr(WeakPtr&& other) noexcept {
         block_ = other.block_;
         observed_ = other.observed_;
         other.block_ = nullptr;
         other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
     }
 
     // Demote `SharedPtr`
     // #2 from https://en.cppreference.com/w/cpp/memory/weak_ptr/weak_ptr
-    WeakPtr(const SharedPtr<T>& other) {
+    WeakPtr(const SharedPtr<T, Policy>& other) {
         observed_ = other.observed_;
         block_ = other.block_;
         if (block_ != nullptr) {
             block_->IncWeakCounter();
         }
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     }
 
-    ////////////////////////////////////////////////////////////////////////////////////////////////
-    // `operator=`-s
-
-    WeakPtr& operator=(const WeakPtr& other) {
-        Reset();
-        block_ = other.block_;
-        observed_ = other.observed_;
+    template <class S>
+    WeakPtr(const WeakPtr<S, Policy>& other) : block_(other.block_), observed_(other.observed_) {
         if (block_ != nullptr) {
             block_->IncWeakCounter();
         }
-        return *this;
+        RecordPtrEvent<T>(PtrEvent::kCopy);
     };
-    WeakPtr& operator=(WeakPtr&& other) {
-        Reset();
-        block_ = other.block_;
-        observed_ = other.observed_;
+    template <class S>
+    WeakPtr(WeakPtr<S, Policy>&& other) noexcept
+        : block_(other.block_), observed_(other.observed_) {
         other.block_ = nullptr;
         other.observed_ = nullptr;
+        RecordPtrEvent<T>(PtrEvent::kMove);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    WeakPtr& operator=(const WeakPtr& other) {
+        WeakPtr(other).Swap(*this);
+        return *this;
+    }
+    WeakPtr& operator=(WeakPtr&& other) noexcept {
+        WeakPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -74,7 +83,7 @@ public:
             observed_ = nullptr;
         }
     }
-    void Swap(WeakPtr& other) {
+    void Swap(WeakPtr& other) noexcept {
         std::swap(block_, other.block_);
         std::swap(observed_, other.observed_);
     }
@@ -94,15 +103,32 @@ public:
         }
         return block_->GetStrongCounter() == 0;
     }
-    SharedPtr<T> Lock() const {
-        SharedPtr<T> result;
-        if (!Expired()) {
+    // Safe against a concurrent release of the last strong reference
+    SharedPtr<T, Policy> Lock() const {
+        SharedPtr<T, Policy> result;
+        TryLock(result, true);
+        return result;
+    }
+    // A single attempt at `Lock()`: returns `kContended` instead of retrying when another
+    // thread changes the strong count at the same moment. `result` is set on success.
+    LockStatus TryLock(SharedPtr<T, Policy>& result) const {
+        return TryLock(result, false);
+    }
+    BaseBlock<Policy>* block_ = nullptr;
+    std::remove_extent_t<T>* observed_ = nullptr;
+
+private:
+    LockStatus TryLock(SharedPtr<T, Policy>& result, bool retry) const {
+        RecordPtrEvent<T>(PtrEvent::kLock);
+        LockStatus status =
+            block_ == nullptr ? LockStatus::kExpired : block_->TryIncStrongCounter(retry);
+        if (status == LockStatus::kLocked) {
+            result.Reset();
             result.block_ = block_;
             result.observed_ = observed_;
-            block_->IncStrongCounter();
+        } else if (status == LockStatus::kExpired) {
+            RecordPtrEvent<T>(PtrEvent::kLockFailed);
         }
-        return result;
+        return status;
     }
-    BaseBlock* block_ = nullptr;
-    T* observed_ = nullptr;
 };